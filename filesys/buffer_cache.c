@@ -0,0 +1,442 @@
+/* buffer_cache.c: Sector cache between the file system and the disk.
+ *
+ * Every sector the file system reads or writes goes through a fixed set
+ * of cache entries.  A miss takes an entry by CLOCK: the hand sweeps the
+ * entries, clearing reference bits, and stops at the first entry that is
+ * neither referenced nor in use.  Writes only dirty the entry; the
+ * flusher thread writes dirty entries back periodically, an evicted dirty
+ * entry is written back before it is reused, and buffer_cache_done()
+ * writes back whatever is left at shutdown.
+ *
+ * Sequential readers queue the sectors they are about to need with
+ * buffer_cache_readahead(), and the read-ahead thread reads them in while
+ * the readers work on what they have.  A prefetched sector starts without
+ * its reference bit, so one nobody uses is the first to go.  How many of
+ * the prefetched sectors get used before they are evicted sets the
+ * largest window a reader may ask for.
+ *
+ * cache_lock protects the sector-to-entry table, the CLOCK hand and each
+ * entry's SECTOR, PIN_CNT and ACCESSED fields.  An entry's own lock
+ * protects its data, and is held across the disk I/O that fills it, so
+ * that a thread that finds an entry while it is being read waits for the
+ * read to finish.  A pinned entry is never evicted.  Eviction writes a
+ * dirty victim back with cache_lock released and the victim pinned, so
+ * that lookups of other sectors do not wait for the disk. */
+
+#include "filesys/buffer_cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Ticks between write-behind passes of the flusher. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+
+/* Sectors waiting for the read-ahead thread, at most. */
+#define RA_QUEUE_SIZE 64
+
+/* Prefetched sectors used or evicted between window adjustments. */
+#define RA_SAMPLE 32
+
+/* A cached sector. */
+struct cache_entry {
+	struct hash_elem elem;              /* Element in cache_table. */
+	disk_sector_t sector;               /* Cached sector, if IN_TABLE. */
+	bool in_table;                      /* Holds a sector? */
+	int pin_cnt;                        /* Users of the entry. */
+	bool accessed;                      /* CLOCK reference bit. */
+	bool prefetched;                    /* Read ahead, not used yet? */
+
+	struct lock lock;                   /* Protects the members below. */
+	bool valid;                         /* DATA read in or written? */
+	bool dirty;                         /* DATA differs from the disk? */
+	uint8_t data[DISK_SECTOR_SIZE];     /* Sector contents. */
+};
+
+size_t buffer_cache_size = BUFFER_CACHE_DEFAULT_SIZE;
+
+static struct cache_entry *cache;
+static struct hash cache_table;
+static struct lock cache_lock;
+static size_t clock_hand;
+
+/* Read-ahead queue, protected by ra_lock. */
+static disk_sector_t ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head, ra_cnt;
+static struct lock ra_lock;
+static struct condition ra_cond;
+
+/* Largest read-ahead window, in sectors, and the prefetched sectors used
+ * and wasted since it was last adjusted.  Protected by cache_lock. */
+static size_t ra_limit;
+static size_t ra_used, ra_wasted;
+
+/* Statistics. */
+static long long hit_cnt;           /* Lookups that found the sector. */
+static long long miss_cnt;          /* Lookups that did not. */
+static long long evict_write_cnt;   /* Dirty entries written on eviction. */
+static long long flush_write_cnt;   /* Dirty entries written behind. */
+static long long ra_read_cnt;       /* Sectors read ahead. */
+static long long ra_used_cnt;       /* Of those, used before eviction. */
+
+static uint64_t cache_hash (const struct hash_elem *e, void *aux);
+static bool cache_less (const struct hash_elem *a,
+		const struct hash_elem *b, void *aux);
+static void flusher (void *aux);
+static void readahead_thread (void *aux);
+
+/* Initializes the buffer cache and starts its flusher thread. */
+void
+buffer_cache_init (void) {
+	size_t i;
+
+	if (buffer_cache_size == 0)
+		buffer_cache_size = BUFFER_CACHE_DEFAULT_SIZE;
+	cache = calloc (buffer_cache_size, sizeof *cache);
+	if (cache == NULL || !hash_init (&cache_table, cache_hash, cache_less,
+				NULL))
+		PANIC ("buffer cache: out of memory");
+	for (i = 0; i < buffer_cache_size; i++)
+		lock_init (&cache[i].lock);
+	lock_init (&cache_lock);
+	lock_init (&ra_lock);
+	cond_init (&ra_cond);
+	ra_limit = buffer_cache_size / 4;
+	if (ra_limit < READAHEAD_MIN_WINDOW)
+		ra_limit = READAHEAD_MIN_WINDOW;
+
+	thread_create ("bc_flusher", PRI_DEFAULT, flusher, NULL);
+	thread_create ("bc_readahead", PRI_DEFAULT, readahead_thread, NULL);
+}
+
+/* Counts a prefetched sector that was USED or evicted unused, and once
+ * RA_SAMPLE have been counted, grows the read-ahead limit if nearly all
+ * of them were used or shrinks it if many were not. */
+static void
+ra_account (bool used) {
+	size_t max = buffer_cache_size / 4;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	if (used) {
+		ra_used++;
+		ra_used_cnt++;
+	} else
+		ra_wasted++;
+	if (ra_used + ra_wasted < RA_SAMPLE)
+		return;
+
+	if (ra_wasted * 8 <= RA_SAMPLE && ra_limit * 2 <= max)
+		ra_limit *= 2;
+	else if (ra_wasted * 4 > RA_SAMPLE && ra_limit / 2 >= READAHEAD_MIN_WINDOW)
+		ra_limit /= 2;
+	ra_used = ra_wasted = 0;
+}
+
+/* Writes E's data back to the disk if it is dirty.
+ * E's lock must be held. */
+static bool
+write_back (struct cache_entry *e) {
+	ASSERT (lock_held_by_current_thread (&e->lock));
+
+	if (!e->valid || !e->dirty)
+		return false;
+	disk_write (filesys_disk, e->sector, e->data);
+	e->dirty = false;
+	return true;
+}
+
+/* Returns the entry for SECTOR, or a null pointer if none. */
+static struct cache_entry *
+lookup (disk_sector_t sector) {
+	struct cache_entry key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&cache_table, &key.elem);
+	return e != NULL ? hash_entry (e, struct cache_entry, elem) : NULL;
+}
+
+/* Chooses an entry to hold a new sector by CLOCK, writes it back if it
+ * is dirty and takes it out of the table.  Returns a null pointer if
+ * every entry is in use.  The write-back releases cache_lock, so the
+ * caller must look the sector it wants up again. */
+static struct cache_entry *
+evict (void) {
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	/* Two sweeps: the first may only clear reference bits. */
+	for (i = 0; i < 2 * buffer_cache_size; i++) {
+		struct cache_entry *e = &cache[clock_hand];
+
+		clock_hand = (clock_hand + 1) % buffer_cache_size;
+		if (e->pin_cnt > 0)
+			continue;
+		if (e->accessed) {
+			e->accessed = false;
+			continue;
+		}
+
+		if (e->in_table) {
+			/* Unpinned, so nobody else holds E's lock.  Pinned, E stays
+			 * in the table during the write, and readers of its sector
+			 * wait on its lock.  If one used it meanwhile, it is no
+			 * longer a victim. */
+			lock_acquire (&e->lock);
+			if (e->valid && e->dirty) {
+				e->pin_cnt++;
+				lock_release (&cache_lock);
+				write_back (e);
+				lock_release (&e->lock);
+				lock_acquire (&cache_lock);
+				evict_write_cnt++;
+				if (--e->pin_cnt > 0 || e->accessed)
+					continue;
+			} else
+				lock_release (&e->lock);
+
+			if (e->prefetched) {
+				e->prefetched = false;
+				ra_account (false);
+			}
+			hash_delete (&cache_table, &e->elem);
+			e->in_table = false;
+		}
+		return e;
+	}
+	return NULL;
+}
+
+/* Returns the entry for SECTOR, pinned and with its lock held.
+ * If FILL, the entry's data is read from the disk if it is not cached
+ * yet; otherwise the caller is about to overwrite the whole sector. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool fill) {
+	struct cache_entry *e;
+
+	lock_acquire (&cache_lock);
+	while ((e = lookup (sector)) == NULL) {
+		e = evict ();
+		if (e == NULL) {
+			/* Every entry is pinned.  Let their users finish. */
+			lock_release (&cache_lock);
+			thread_yield ();
+			lock_acquire (&cache_lock);
+		} else if (lookup (sector) == NULL) {
+			e->sector = sector;
+			e->in_table = true;
+			e->valid = false;
+			e->dirty = false;
+			e->prefetched = false;
+			hash_insert (&cache_table, &e->elem);
+			break;
+		}
+		/* Otherwise another thread brought SECTOR in while evict()
+		 * wrote back, and E stays free for the next miss. */
+	}
+	e->pin_cnt++;
+	e->accessed = true;
+	if (e->prefetched) {
+		e->prefetched = false;
+		ra_account (true);
+	}
+	lock_release (&cache_lock);
+
+	lock_acquire (&e->lock);
+	if (e->valid)
+		hit_cnt++;
+	else {
+		miss_cnt++;
+		if (fill) {
+			disk_read (filesys_disk, sector, e->data);
+			e->valid = true;
+		}
+	}
+	return e;
+}
+
+/* Releases E, which cache_get() returned. */
+static void
+cache_put (struct cache_entry *e) {
+	lock_release (&e->lock);
+
+	lock_acquire (&cache_lock);
+	ASSERT (e->pin_cnt > 0);
+	e->pin_cnt--;
+	lock_release (&cache_lock);
+}
+
+/* Copies SIZE bytes starting at offset OFS of SECTOR into BUFFER. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer, off_t ofs,
+		size_t size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, true);
+	memcpy (buffer, e->data + ofs, size);
+	cache_put (e);
+}
+
+/* Copies SIZE bytes from BUFFER to offset OFS of SECTOR.  The sector
+ * reaches the disk later. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer, off_t ofs,
+		size_t size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, ofs != 0 || size != DISK_SECTOR_SIZE);
+	memcpy (e->data + ofs, buffer, size);
+	e->valid = true;
+	e->dirty = true;
+	cache_put (e);
+}
+
+/* Queues SECTOR to be read into the cache by the read-ahead thread.
+ * Does nothing if the queue is full. */
+void
+buffer_cache_readahead (disk_sector_t sector) {
+	lock_acquire (&ra_lock);
+	if (ra_cnt < RA_QUEUE_SIZE) {
+		ra_queue[(ra_head + ra_cnt++) % RA_QUEUE_SIZE] = sector;
+		cond_signal (&ra_cond, &ra_lock);
+	}
+	lock_release (&ra_lock);
+}
+
+/* Returns the largest number of sectors a reader should read ahead. */
+size_t
+buffer_cache_readahead_limit (void) {
+	return ra_limit;
+}
+
+/* Reads SECTOR into the cache unless it is already there. */
+static void
+prefetch (disk_sector_t sector) {
+	struct cache_entry *e;
+
+	lock_acquire (&cache_lock);
+	if (lookup (sector) != NULL || (e = evict ()) == NULL
+			|| lookup (sector) != NULL) {
+		lock_release (&cache_lock);
+		return;
+	}
+	e->sector = sector;
+	e->in_table = true;
+	e->valid = false;
+	e->dirty = false;
+	e->prefetched = true;
+	e->accessed = false;
+	e->pin_cnt++;
+	hash_insert (&cache_table, &e->elem);
+
+	/* Readers that find E from now on wait for the read. */
+	lock_acquire (&e->lock);
+	lock_release (&cache_lock);
+
+	disk_read (filesys_disk, sector, e->data);
+	e->valid = true;
+	ra_read_cnt++;
+	cache_put (e);
+}
+
+/* Read-ahead thread: reads in the queued sectors. */
+static void
+readahead_thread (void *aux UNUSED) {
+	for (;;) {
+		disk_sector_t sector;
+
+		lock_acquire (&ra_lock);
+		while (ra_cnt == 0)
+			cond_wait (&ra_cond, &ra_lock);
+		sector = ra_queue[ra_head];
+		ra_head = (ra_head + 1) % RA_QUEUE_SIZE;
+		ra_cnt--;
+		lock_release (&ra_lock);
+
+		prefetch (sector);
+	}
+}
+
+/* Writes every dirty entry back to the disk.
+ * Returns the number of sectors written. */
+static size_t
+flush_all (void) {
+	size_t i, cnt = 0;
+
+	for (i = 0; i < buffer_cache_size; i++) {
+		struct cache_entry *e = &cache[i];
+
+		lock_acquire (&cache_lock);
+		if (!e->in_table) {
+			lock_release (&cache_lock);
+			continue;
+		}
+		e->pin_cnt++;
+		lock_release (&cache_lock);
+
+		lock_acquire (&e->lock);
+		if (write_back (e))
+			cnt++;
+		cache_put (e);
+	}
+	return cnt;
+}
+
+/* Writes every dirty entry back to the disk. */
+void
+buffer_cache_flush (void) {
+	flush_all ();
+}
+
+/* Writes the cache back before the file system shuts down. */
+void
+buffer_cache_done (void) {
+	flush_all ();
+}
+
+/* Flusher thread: writes dirty entries behind, every FLUSH_INTERVAL
+ * ticks. */
+static void
+flusher (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (FLUSH_INTERVAL);
+		flush_write_cnt += flush_all ();
+	}
+}
+
+/* Prints buffer cache statistics. */
+void
+buffer_cache_print_stats (void) {
+	if (cache == NULL)
+		return;
+	printf ("Buffer cache: %zu sectors, %lld hits, %lld misses, "
+			"%lld written on eviction, %lld written behind\n",
+			buffer_cache_size, hit_cnt, miss_cnt, evict_write_cnt,
+			flush_write_cnt);
+	printf ("Read-ahead: %lld sectors read, %lld used, window limit %zu\n",
+			ra_read_cnt, ra_used_cnt, ra_limit);
+}
+
+static uint64_t
+cache_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct cache_entry *c = hash_entry (e, struct cache_entry, elem);
+	return hash_int (c->sector);
+}
+
+static bool
+cache_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct cache_entry, elem)->sector
+		< hash_entry (b, struct cache_entry, elem)->sector;
+}
@@ -0,0 +1,192 @@
+/* dcache.c: Cache of directory entries.
+ *
+ * Maps a (directory inode sector, name) pair to the sector of the
+ * inode the name refers to, or records that the directory has no such
+ * name (a negative entry), so that repeated lookups of the same names,
+ * and creations of new ones, do not read the directory.  The directory
+ * code keeps the cache in step: dir_add() and dir_remove() update the
+ * entry for the name they change, and dir_create() drops whatever is
+ * cached for a directory that used to live in the same sector.  At
+ * most DCACHE_SIZE names are cached; the least recently used goes
+ * first. */
+
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* A cached name. */
+struct dentry {
+	struct hash_elem hash_elem;         /* Element in dcache_table. */
+	struct list_elem lru_elem;          /* Element in lru_list. */
+	disk_sector_t dir;                  /* Directory inode sector. */
+	char name[NAME_MAX + 1];            /* Null terminated name. */
+	bool negative;                      /* DIR has no entry NAME? */
+	disk_sector_t inode_sector;         /* NAME's inode, if not NEGATIVE. */
+};
+
+static struct hash dcache_table;
+static struct list lru_list;            /* Most recently used first. */
+static size_t dcache_cnt;
+static struct lock dcache_lock;
+
+/* Statistics. */
+static long long hit_cnt;               /* Lookups that found a name. */
+static long long negative_hit_cnt;      /* Lookups that found no name. */
+static long long miss_cnt;              /* Lookups not cached. */
+
+static uint64_t dentry_hash (const struct hash_elem *e, void *aux);
+static bool dentry_less (const struct hash_elem *a,
+		const struct hash_elem *b, void *aux);
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void) {
+	if (!hash_init (&dcache_table, dentry_hash, dentry_less, NULL))
+		PANIC ("dcache: out of memory");
+	list_init (&lru_list);
+	lock_init (&dcache_lock);
+}
+
+/* Returns the cached entry for NAME in DIR, or a null pointer. */
+static struct dentry *
+find (disk_sector_t dir, const char *name) {
+	struct dentry key;
+	struct hash_elem *e;
+
+	key.dir = dir;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dcache_table, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Looks up NAME in directory DIR.  If the cache knows NAME exists,
+ * stores its inode sector in *INODE_SECTOR. */
+enum dcache_result
+dcache_lookup (disk_sector_t dir, const char *name,
+		disk_sector_t *inode_sector) {
+	enum dcache_result result = DCACHE_MISS;
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return DCACHE_MISS;
+
+	lock_acquire (&dcache_lock);
+	d = find (dir, name);
+	if (d == NULL)
+		miss_cnt++;
+	else {
+		list_remove (&d->lru_elem);
+		list_push_front (&lru_list, &d->lru_elem);
+		if (d->negative) {
+			negative_hit_cnt++;
+			result = DCACHE_NEGATIVE;
+		} else {
+			hit_cnt++;
+			*inode_sector = d->inode_sector;
+			result = DCACHE_POSITIVE;
+		}
+	}
+	lock_release (&dcache_lock);
+	return result;
+}
+
+/* Frees D, which must be in the cache. */
+static void
+drop (struct dentry *d) {
+	hash_delete (&dcache_table, &d->hash_elem);
+	list_remove (&d->lru_elem);
+	dcache_cnt--;
+	free (d);
+}
+
+/* Caches NAME in DIR as referring to INODE_SECTOR, or as absent if
+ * NEGATIVE. */
+static void
+enter (disk_sector_t dir, const char *name, bool negative,
+		disk_sector_t inode_sector) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dcache_lock);
+	d = find (dir, name);
+	if (d != NULL)
+		list_remove (&d->lru_elem);
+	else {
+		d = malloc (sizeof *d);
+		if (d == NULL) {
+			lock_release (&dcache_lock);
+			return;
+		}
+		if (dcache_cnt == DCACHE_SIZE)
+			drop (list_entry (list_back (&lru_list), struct dentry, lru_elem));
+		d->dir = dir;
+		strlcpy (d->name, name, sizeof d->name);
+		hash_insert (&dcache_table, &d->hash_elem);
+		dcache_cnt++;
+	}
+	d->negative = negative;
+	d->inode_sector = inode_sector;
+	list_push_front (&lru_list, &d->lru_elem);
+	lock_release (&dcache_lock);
+}
+
+/* Caches NAME in DIR as referring to the inode in INODE_SECTOR. */
+void
+dcache_enter (disk_sector_t dir, const char *name,
+		disk_sector_t inode_sector) {
+	enter (dir, name, false, inode_sector);
+}
+
+/* Caches that DIR has no entry NAME. */
+void
+dcache_enter_negative (disk_sector_t dir, const char *name) {
+	enter (dir, name, true, 0);
+}
+
+/* Drops every cached name in DIR. */
+void
+dcache_invalidate_dir (disk_sector_t dir) {
+	struct list_elem *e, *next;
+
+	lock_acquire (&dcache_lock);
+	for (e = list_begin (&lru_list); e != list_end (&lru_list); e = next) {
+		struct dentry *d = list_entry (e, struct dentry, lru_elem);
+
+		next = list_next (e);
+		if (d->dir == dir)
+			drop (d);
+	}
+	lock_release (&dcache_lock);
+}
+
+/* Prints directory entry cache statistics. */
+void
+dcache_print_stats (void) {
+	printf ("Dentry cache: %zu names, %lld hits, %lld negative hits, "
+			"%lld misses\n", dcache_cnt, hit_cnt, negative_hit_cnt, miss_cnt);
+}
+
+static uint64_t
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+	return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+	const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+	if (a->dir != b->dir)
+		return a->dir < b->dir;
+	return strcmp (a->name, b->name) < 0;
+}
@@ -1,7 +1,9 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -17,13 +19,68 @@ struct dir_entry {
 	disk_sector_t inode_sector;         /* Sector number of header. */
 	char name[NAME_MAX + 1];            /* Null terminated file name. */
 	bool in_use;                        /* In use or free? */
+	bool removed;                       /* Freed by dir_remove()? */
 };
 
+/* A directory is an array of entry slots.  One with at most
+ * SMALL_DIR_SLOTS slots keeps its entries in any free slot and is
+ * searched linearly, which reads no more than a sector or so.  A larger
+ * one is an open-addressed hash table with a power-of-two number of
+ * slots: an entry lives in the first free slot at or after the hash of
+ * its name, so a lookup stops at the first slot that was never used.
+ * Removed entries stay marked REMOVED so that they do not cut probe
+ * sequences short, and dir_add() reuses them.  When dir_add() finds no
+ * free slot within MAX_PROBE slots it rebuilds the directory with twice
+ * as many, which also drops the removed entries.
+ *
+ * Lookups, additions and removals in a directory hold its inode's
+ * directory lock, so that each sees the others whole, and the dentry
+ * cache never disagrees with the entries on disk. */
+#define SMALL_DIR_SLOTS 16
+#define MAX_PROBE 16
+
+/* Returns the number of entry slots in DIR.  A hash table uses the
+ * largest power of two that fits, ignoring any slots left past it by a
+ * rehash() that ran out of disk space. */
+static size_t
+dir_slots (const struct dir *dir) {
+	size_t slots = inode_length (dir->inode) / sizeof (struct dir_entry);
+
+	if (slots > SMALL_DIR_SLOTS)
+		while (slots & (slots - 1))
+			slots &= slots - 1;
+	return slots;
+}
+
+/* Returns true if a directory of SLOTS slots is a hash table. */
+static inline bool
+is_hashed (size_t slots) {
+	return slots > SMALL_DIR_SLOTS;
+}
+
+/* Returns the first slot to probe for NAME in a hash table of SLOTS
+ * slots. */
+static size_t
+home_slot (const char *name, size_t slots) {
+	return hash_string (name) & (slots - 1);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
  * given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) {
-	return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+	size_t slots = entry_cnt;
+
+	if (is_hashed (slots)) {
+		/* Round up to a power of two. */
+		slots = SMALL_DIR_SLOTS * 2;
+		while (slots < entry_cnt)
+			slots *= 2;
+	}
+
+	/* Forget the names of any directory that used to be here. */
+	dcache_invalidate_dir (sector);
+	return inode_create (sector, slots * sizeof (struct dir_entry));
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -80,21 +137,121 @@ static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
 	struct dir_entry e;
-	size_t ofs;
+	size_t slots, slot, i;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (e.in_use && !strcmp (name, e.name)) {
-			if (ep != NULL)
-				*ep = e;
-			if (ofsp != NULL)
-				*ofsp = ofs;
-			return true;
+	slots = dir_slots (dir);
+	if (!is_hashed (slots)) {
+		/* Small directory: read all of it at once and scan. */
+		struct dir_entry table[SMALL_DIR_SLOTS];
+		off_t size = slots * sizeof e;
+
+		if (inode_read_at (dir->inode, table, size, 0) != size)
+			return false;
+		for (slot = 0; slot < slots; slot++)
+			if (table[slot].in_use && !strcmp (name, table[slot].name))
+				break;
+		if (slot == slots)
+			return false;
+		e = table[slot];
+	} else {
+		/* Probe from NAME's home slot up to a slot never used. */
+		slot = home_slot (name, slots);
+		for (i = 0; ; i++, slot = (slot + 1) & (slots - 1)) {
+			if (i == slots
+					|| inode_read_at (dir->inode, &e, sizeof e,
+						slot * sizeof e) != sizeof e
+					|| (!e.in_use && !e.removed))
+				return false;
+			if (e.in_use && !strcmp (name, e.name))
+				break;
+		}
+	}
+
+	if (ep != NULL)
+		*ep = e;
+	if (ofsp != NULL)
+		*ofsp = slot * sizeof e;
+	return true;
+}
+
+/* Rebuilds DIR as a hash table of NEW_SLOTS slots, a power of two
+ * larger than SMALL_DIR_SLOTS, leaving out removed entries.
+ * Returns true if successful, false if memory or disk space runs
+ * out. */
+static bool
+rehash (struct dir *dir, size_t new_slots) {
+	size_t old_slots = dir_slots (dir);
+	off_t old_size = old_slots * sizeof (struct dir_entry);
+	off_t new_size = new_slots * sizeof (struct dir_entry);
+	struct dir_entry *old = malloc (old_size + 1);
+	struct dir_entry *new = calloc (new_slots, sizeof *new);
+	bool success = false;
+	uint8_t zero = 0;
+	size_t i;
+
+	ASSERT (is_hashed (new_slots) && new_slots > old_slots);
+
+	if (old == NULL || new == NULL
+			|| inode_read_at (dir->inode, old, old_size, 0) != old_size)
+		goto done;
+
+	for (i = 0; i < old_slots; i++)
+		if (old[i].in_use) {
+			size_t slot = home_slot (old[i].name, new_slots);
+			while (new[slot].in_use)
+				slot = (slot + 1) & (new_slots - 1);
+			new[slot] = old[i];
+		}
+
+	/* Grow DIR before overwriting the old table, which stays valid if
+	 * the disk fills up part way. */
+	if (inode_write_at (dir->inode, &zero, 1, new_size - 1) != 1
+			|| inode_length (dir->inode) != new_size)
+		goto done;
+	success = inode_write_at (dir->inode, new, new_size, 0) == new_size;
+
+done:
+	free (old);
+	free (new);
+	return success;
+}
+
+/* Finds a free slot in DIR for an entry named NAME and sets *OFSP to
+ * its byte offset, which may be the current end of file.  Grows DIR if
+ * it has no free slot close enough.
+ * Returns true if successful, false if DIR cannot grow. */
+static bool
+find_free_slot (struct dir *dir, const char *name, off_t *ofsp) {
+	struct dir_entry e;
+
+	for (;;) {
+		size_t slots = dir_slots (dir), slot, i;
+
+		if (!is_hashed (slots)) {
+			for (slot = 0; slot < slots; slot++)
+				if (inode_read_at (dir->inode, &e, sizeof e, slot * sizeof e)
+						== sizeof e && !e.in_use)
+					break;
+			if (slot < SMALL_DIR_SLOTS) {
+				*ofsp = slot * sizeof e;
+				return true;
+			}
+		} else {
+			slot = home_slot (name, slots);
+			for (i = 0; i < MAX_PROBE; i++, slot = (slot + 1) & (slots - 1))
+				if (inode_read_at (dir->inode, &e, sizeof e, slot * sizeof e)
+						== sizeof e && !e.in_use) {
+					*ofsp = slot * sizeof e;
+					return true;
+				}
 		}
-	return false;
+
+		if (!rehash (dir, is_hashed (slots) ? slots * 2 : SMALL_DIR_SLOTS * 2))
+			return false;
+	}
 }
 
 /* Searches DIR for a file with the given NAME
@@ -104,15 +261,34 @@ lookup (const struct dir *dir, const char *name,
 bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
+	disk_sector_t dir_sector, inode_sector;
 	struct dir_entry e;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
-		*inode = inode_open (e.inode_sector);
-	else
-		*inode = NULL;
+	dir_sector = inode_get_inumber (dir->inode);
+
+	/* Opening the inode before unlocking keeps a concurrent
+	 * dir_remove() from freeing it first. */
+	inode_lock_dir (dir->inode);
+	switch (dcache_lookup (dir_sector, name, &inode_sector)) {
+		case DCACHE_POSITIVE:
+			*inode = inode_open (inode_sector);
+			break;
+		case DCACHE_NEGATIVE:
+			*inode = NULL;
+			break;
+		default:
+			if (lookup (dir, name, &e, NULL)) {
+				dcache_enter (dir_sector, name, e.inode_sector);
+				*inode = inode_open (e.inode_sector);
+			} else {
+				dcache_enter_negative (dir_sector, name);
+				*inode = NULL;
+			}
+	}
+	inode_unlock_dir (dir->inode);
 
 	return *inode != NULL;
 }
@@ -125,6 +301,7 @@ dir_lookup (const struct dir *dir, const char *name,
  * error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+	disk_sector_t dir_sector, cached_sector;
 	struct dir_entry e;
 	off_t ofs;
 	bool success = false;
@@ -132,33 +309,40 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	dir_sector = inode_get_inumber (dir->inode);
+
 	/* Check NAME for validity. */
 	if (*name == '\0' || strlen (name) > NAME_MAX)
 		return false;
 
-	/* Check that NAME is not in use. */
-	if (lookup (dir, name, NULL, NULL))
-		goto done;
-
-	/* Set OFS to offset of free slot.
-	 * If there are no free slots, then it will be set to the
-	 * current end-of-file.
-
-	 * inode_read_at() will only return a short read at end of file.
-	 * Otherwise, we'd need to verify that we didn't get a short
-	 * read due to something intermittent such as low memory. */
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (!e.in_use)
+	/* Check that NAME is not in use.  A cached negative entry saves
+	 * reading the directory. */
+	inode_lock_dir (dir->inode);
+	switch (dcache_lookup (dir_sector, name, &cached_sector)) {
+		case DCACHE_POSITIVE:
+			goto done;
+		case DCACHE_NEGATIVE:
 			break;
+		default:
+			if (lookup (dir, name, NULL, NULL))
+				goto done;
+	}
+
+	/* Set OFS to offset of free slot, growing DIR if needed. */
+	if (!find_free_slot (dir, name, &ofs))
+		goto done;
 
 	/* Write slot. */
 	e.in_use = true;
+	e.removed = false;
 	strlcpy (e.name, name, sizeof e.name);
 	e.inode_sector = inode_sector;
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+	if (success)
+		dcache_enter (dir_sector, name, inode_sector);
 
 done:
+	inode_unlock_dir (dir->inode);
 	return success;
 }
 
@@ -176,6 +360,7 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (name != NULL);
 
 	/* Find directory entry. */
+	inode_lock_dir (dir->inode);
 	if (!lookup (dir, name, &e, &ofs))
 		goto done;
 
@@ -186,14 +371,17 @@ dir_remove (struct dir *dir, const char *name) {
 
 	/* Erase directory entry. */
 	e.in_use = false;
+	e.removed = true;
 	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
 
 	/* Remove inode. */
 	inode_remove (inode);
+	dcache_enter_negative (inode_get_inumber (dir->inode), name);
 	success = true;
 
 done:
+	inode_unlock_dir (dir->inode);
 	inode_close (inode);
 	return success;
 }
@@ -204,13 +392,17 @@ done:
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
+	bool found = false;
 
+	inode_lock_dir (dir->inode);
 	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
 		if (e.in_use) {
 			strlcpy (name, e.name, NAME_MAX + 1);
-			return true;
+			found = true;
+			break;
 		}
 	}
-	return false;
+	inode_unlock_dir (dir->inode);
+	return found;
 }
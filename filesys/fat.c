@@ -1,8 +1,10 @@
 #include "filesys/fat.h"
 #include "devices/disk.h"
+#include "filesys/buffer_cache.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
+#include <bitmap.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -24,10 +26,22 @@ struct fat_fs {
 	disk_sector_t data_start;
 	cluster_t last_clst;
 	struct lock write_lock;
+	struct bitmap *used_map;    /* One bit per cluster, set if in use. */
+	size_t free_cnt;            /* Number of free clusters. */
+	struct bitmap *dirty_map;   /* One bit per FAT sector, set if not
+	                               written since it changed. */
 };
 
 static struct fat_fs *fat_fs;
 
+/* Allocation statistics. */
+static long long alloc_cnt;         /* Clusters allocated. */
+static long long contig_cnt;        /* Of those, right after their predecessor. */
+static long long scan_cnt;          /* Searches of the free-cluster bitmap. */
+static long long sync_cnt;          /* FAT sectors written back. */
+
+static void fat_build_used_map (void);
+
 void fat_boot_create (void);
 void fat_fs_init (void);
 
@@ -38,12 +52,7 @@ fat_init (void) {
 		PANIC ("FAT init failed");
 
 	// Read boot sector from the disk
-	unsigned int *bounce = malloc (DISK_SECTOR_SIZE);
-	if (bounce == NULL)
-		PANIC ("FAT init failed");
-	disk_read (filesys_disk, FAT_BOOT_SECTOR, bounce);
-	memcpy (&fat_fs->bs, bounce, sizeof (fat_fs->bs));
-	free (bounce);
+	buffer_cache_read (FAT_BOOT_SECTOR, &fat_fs->bs, 0, sizeof (fat_fs->bs));
 
 	// Extract FAT info
 	if (fat_fs->bs.magic != FAT_MAGIC)
@@ -53,31 +62,28 @@ fat_init (void) {
 
 void
 fat_open (void) {
+	free (fat_fs->fat);
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT load failed");
 
-	// Load FAT directly from the disk
+	// Load FAT through the buffer cache
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
 	off_t bytes_read = 0;
 	off_t bytes_left = sizeof (fat_fs->fat);
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
 		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy (buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free (bounce);
-		}
+		if (bytes_left <= 0)
+			break;
+		if (bytes_left > DISK_SECTOR_SIZE)
+			bytes_left = DISK_SECTOR_SIZE;
+		buffer_cache_read (fat_fs->bs.fat_start + i, buffer + bytes_read, 0,
+		                   bytes_left);
+		bytes_read += bytes_left;
 	}
+	fat_build_used_map ();
+	bitmap_set_all (fat_fs->dirty_map, false);
 }
 
 void
@@ -87,30 +93,37 @@ fat_close (void) {
 	if (bounce == NULL)
 		PANIC ("FAT close failed");
 	memcpy (bounce, &fat_fs->bs, sizeof (fat_fs->bs));
-	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
+	buffer_cache_write (FAT_BOOT_SECTOR, bounce, 0, DISK_SECTOR_SIZE);
 	free (bounce);
 
-	// Write FAT directly to the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
+	// Write the FAT sectors that changed
+	fat_sync ();
+}
+
+/* Writes the FAT sectors that changed since they were last written.
+ * They go through the buffer cache, which takes them to disk. */
+void
+fat_sync (void) {
+	const uint8_t *buffer = (const uint8_t *) fat_fs->fat;
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
+
+	lock_acquire (&fat_fs->write_lock);
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT close failed");
-			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
-			free (bounce);
-		}
+		off_t bytes_wrote = (off_t) i * DISK_SECTOR_SIZE;
+		off_t bytes_left = fat_size_in_bytes - bytes_wrote;
+
+		if (!bitmap_test (fat_fs->dirty_map, i))
+			continue;
+		bitmap_reset (fat_fs->dirty_map, i);
+		if (bytes_left <= 0)
+			continue;
+		if (bytes_left > DISK_SECTOR_SIZE)
+			bytes_left = DISK_SECTOR_SIZE;
+		buffer_cache_write (fat_fs->bs.fat_start + i, buffer + bytes_wrote, 0,
+		                    bytes_left);
+		sync_cnt++;
 	}
+	lock_release (&fat_fs->write_lock);
 }
 
 void
@@ -123,6 +136,8 @@ fat_create (void) {
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT creation failed");
+	fat_build_used_map ();
+	bitmap_set_all (fat_fs->dirty_map, true);
 
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
@@ -131,7 +146,8 @@ fat_create (void) {
 	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
 	if (buf == NULL)
 		PANIC ("FAT create failed due to OOM");
-	disk_write (filesys_disk, cluster_to_sector (ROOT_DIR_CLUSTER), buf);
+	buffer_cache_write (cluster_to_sector (ROOT_DIR_CLUSTER), buf, 0,
+	                    DISK_SECTOR_SIZE);
 	free (buf);
 }
 
@@ -152,42 +168,194 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+	                     / SECTORS_PER_CLUSTER;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER + 1;
+	lock_init (&fat_fs->write_lock);
+
+	if (fat_fs->dirty_map != NULL)
+		bitmap_destroy (fat_fs->dirty_map);
+	fat_fs->dirty_map = bitmap_create (fat_fs->bs.fat_sectors);
+	if (fat_fs->dirty_map == NULL)
+		PANIC ("FAT bitmap creation failed");
+}
+
+/* Builds the free-cluster bitmap from the FAT.  Cluster 0 stands for
+ * "no cluster", so it is never free. */
+static void
+fat_build_used_map (void) {
+	cluster_t clst;
+
+	if (fat_fs->used_map != NULL)
+		bitmap_destroy (fat_fs->used_map);
+	fat_fs->used_map = bitmap_create (fat_fs->fat_length);
+	if (fat_fs->used_map == NULL)
+		PANIC ("FAT bitmap creation failed");
+
+	bitmap_mark (fat_fs->used_map, 0);
+	for (clst = 1; clst < fat_fs->fat_length; clst++)
+		if (fat_fs->fat[clst] != 0)
+			bitmap_mark (fat_fs->used_map, clst);
+	fat_fs->free_cnt = bitmap_count (fat_fs->used_map, 0,
+	                                 fat_fs->fat_length, false);
+}
+
+/* Prints FAT allocation statistics. */
+void
+fat_print_stats (void) {
+	if (fat_fs == NULL || fat_fs->used_map == NULL)
+		return;
+	printf ("FAT: %zu of %u clusters free, %lld allocated "
+	        "(%lld contiguous), %lld bitmap scans, %lld sectors written\n",
+	        fat_fs->free_cnt, fat_fs->fat_length - 1, alloc_cnt, contig_cnt,
+	        scan_cnt, sync_cnt);
 }
 
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
 
+/* Sets FAT entry CLST to VAL and keeps the free-cluster bitmap in step.
+ * The caller must hold write_lock. */
+static void
+set_entry (cluster_t clst, cluster_t val) {
+	bool was_used;
+
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	ASSERT (lock_held_by_current_thread (&fat_fs->write_lock));
+
+	was_used = fat_fs->fat[clst] != 0;
+	fat_fs->fat[clst] = val;
+	bitmap_mark (fat_fs->dirty_map,
+	             clst * sizeof (cluster_t) / DISK_SECTOR_SIZE);
+	if (was_used && val == 0) {
+		bitmap_reset (fat_fs->used_map, clst);
+		fat_fs->free_cnt++;
+	} else if (!was_used && val != 0) {
+		bitmap_mark (fat_fs->used_map, clst);
+		fat_fs->free_cnt--;
+	}
+}
+
+/* Returns the first of CNT free clusters in a row, searching forward
+ * from the next-fit hint and then from the start of the disk, or 0 if
+ * there is no such run. */
+static cluster_t
+find_free_run (size_t cnt) {
+	size_t clst;
+
+	scan_cnt++;
+	clst = bitmap_scan (fat_fs->used_map, fat_fs->last_clst, cnt, false);
+	if (clst == BITMAP_ERROR)
+		clst = bitmap_scan (fat_fs->used_map, 0, cnt, false);
+	return clst != BITMAP_ERROR ? clst : 0;
+}
+
+/* Allocates CNT clusters and links them after CLST, or as a new chain
+ * if CLST is 0.  The clusters right after CLST are taken if they are
+ * free, then the next free run long enough for the rest, and single
+ * free clusters only when there is no such run, so a chain that grows
+ * one append at a time stays contiguous as long as the disk allows.
+ * Returns the first new cluster, or 0 if fewer than CNT clusters are
+ * free, in which case nothing is allocated. */
+cluster_t
+fat_extend_chain (cluster_t clst, size_t cnt) {
+	cluster_t first = 0, prev = clst;
+
+	lock_acquire (&fat_fs->write_lock);
+	if (cnt == 0 || cnt > fat_fs->free_cnt) {
+		lock_release (&fat_fs->write_lock);
+		return 0;
+	}
+
+	while (cnt > 0) {
+		cluster_t start = 0;
+		size_t run = 0, i;
+
+		/* Continue right after PREV. */
+		if (prev != 0) {
+			start = prev + 1;
+			while (run < cnt && start + run < fat_fs->fat_length
+			       && !bitmap_test (fat_fs->used_map, start + run))
+				run++;
+		}
+		if (run == 0) {
+			run = cnt;
+			start = find_free_run (run);
+			if (start == 0) {
+				run = 1;
+				start = find_free_run (run);
+			}
+			ASSERT (start != 0);
+		}
+
+		for (i = 0; i < run; i++)
+			set_entry (start + i, i + 1 < run ? start + i + 1 : EOChain);
+		if (prev != 0)
+			set_entry (prev, start);
+
+		alloc_cnt += run;
+		contig_cnt += prev != 0 && start == prev + 1 ? run : run - 1;
+		if (first == 0)
+			first = start;
+		prev = start + run - 1;
+		cnt -= run;
+	}
+
+	fat_fs->last_clst = prev + 1 < fat_fs->fat_length ? prev + 1 : 1;
+	lock_release (&fat_fs->write_lock);
+	return first;
+}
+
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
  * Returns 0 if fails to allocate a new cluster. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	return fat_extend_chain (clst, 1);
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	if (pclst != 0)
+		set_entry (pclst, EOChain);
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat_fs->fat[clst];
+		set_entry (clst, 0);
+		clst = next;
+	}
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	set_entry (clst, val);
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Converts a sector number in the data region to its cluster #. */
+cluster_t
+sector_to_cluster (disk_sector_t sector) {
+	ASSERT (sector >= fat_fs->data_start);
+	return (sector - fat_fs->data_start) / SECTORS_PER_CLUSTER + 1;
 }
@@ -1,13 +1,22 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include "filesys/buffer_cache.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Sequential read-ahead state of an open file. */
+struct readahead {
+	off_t next;                 /* Where a sequential read would start. */
+	off_t end;                  /* End of the data read ahead so far. */
+	size_t window;              /* Sectors to read ahead next time. */
+};
+
 /* An open file. */
 struct file {
 	struct inode *inode;        /* File's inode. */
 	off_t pos;                  /* Current position. */
 	bool deny_write;            /* Has file_deny_write() been called? */
+	struct readahead ra;        /* Read-ahead state. */
 };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -64,6 +73,41 @@ file_get_inode (struct file *file) {
 	return file->inode;
 }
 
+/* Notes that BYTES bytes were just read from FILE at offset POS.
+ * While FILE is read sequentially, keeps a window of sectors ahead of
+ * the reader queued for read-ahead: when the reader gets within half a
+ * window of the end of the data read ahead, queues the next window and
+ * doubles it, up to the limit the buffer cache sets.  A read anywhere
+ * else stops the read-ahead until reads are sequential again. */
+static void
+file_readahead (struct file *file, off_t pos, off_t bytes) {
+	struct readahead *ra = &file->ra;
+	size_t limit = buffer_cache_readahead_limit ();
+
+	if (pos != ra->next) {
+		ra->next = pos + bytes;
+		ra->end = ra->next;
+		ra->window = 0;
+		return;
+	}
+	ra->next = pos + bytes;
+	if (bytes == 0)
+		return;
+
+	if (ra->window == 0)
+		ra->window = READAHEAD_MIN_WINDOW;
+	if (ra->window > limit)
+		ra->window = limit;
+	if (ra->end < ra->next)
+		ra->end = ra->next;
+	if (ra->end - ra->next > (off_t) ra->window * DISK_SECTOR_SIZE / 2)
+		return;
+
+	ra->end = inode_readahead (file->inode, ra->end, ra->window);
+	if (ra->window * 2 <= limit)
+		ra->window *= 2;
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
  * starting at the file's current position.
  * Returns the number of bytes actually read,
@@ -72,6 +116,7 @@ file_get_inode (struct file *file) {
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
 	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	file_readahead (file, file->pos, bytes_read);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -89,9 +134,8 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at the file's current position.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk fills up.
+ * Writing past end of file grows the file.
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) {
@@ -103,9 +147,8 @@ file_write (struct file *file, const void *buffer, off_t size) {
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at offset FILE_OFS in the file.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk fills up.
+ * Writing past end of file grows the file.
  * The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
@@ -2,6 +2,8 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
@@ -21,6 +23,8 @@ filesys_init (bool format) {
 	if (filesys_disk == NULL)
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
+	buffer_cache_init ();
+	dcache_init ();
 	inode_init ();
 
 #ifdef EFILESYS
@@ -51,6 +55,7 @@ filesys_done (void) {
 #else
 	free_map_close ();
 #endif
+	buffer_cache_done ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -61,12 +66,23 @@ bool
 filesys_create (const char *name, off_t initial_size) {
 	disk_sector_t inode_sector = 0;
 	struct dir *dir = dir_open_root ();
+#ifdef EFILESYS
+	cluster_t inode_clst = 0;
+	bool success = (dir != NULL
+			&& (inode_clst = fat_create_chain (0)) != 0
+			&& inode_create (inode_sector = cluster_to_sector (inode_clst),
+				initial_size)
+			&& dir_add (dir, name, inode_sector));
+	if (!success && inode_clst != 0)
+		fat_remove_chain (inode_clst, 0);
+#else
 	bool success = (dir != NULL
 			&& free_map_allocate (1, &inode_sector)
 			&& inode_create (inode_sector, initial_size)
 			&& dir_add (dir, name, inode_sector));
 	if (!success && inode_sector != 0)
 		free_map_release (inode_sector, 1);
+#endif
 	dir_close (dir);
 
 	return success;
@@ -110,6 +126,8 @@ do_format (void) {
 #ifdef EFILESYS
 	/* Create FAT and save it to the disk. */
 	fat_create ();
+	if (!dir_create (ROOT_DIR_SECTOR, 16))
+		PANIC ("root directory creation failed");
 	fat_close ();
 #else
 	free_map_create ();
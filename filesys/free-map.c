@@ -1,19 +1,41 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static struct bitmap *dirty_map;     /* One bit per free map file sector,
+                                        set if not written since it
+                                        changed. */
+static struct lock free_map_lock;    /* Protects FREE_MAP and DIRTY_MAP. */
+
+/* Notes that the bits for the CNT sectors starting at SECTOR changed,
+ * so the free map file sectors that hold them need writing. */
+static void
+mark_dirty (disk_sector_t sector, size_t cnt) {
+	size_t first = sector / 8 / DISK_SECTOR_SIZE;
+	size_t last = (sector + cnt - 1) / 8 / DISK_SECTOR_SIZE;
+
+	if (cnt > 0)
+		bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+}
 
 /* Initializes the free map. */
 void
 free_map_init (void) {
+	lock_init (&free_map_lock);
 	free_map = bitmap_create (disk_size (filesys_disk));
 	if (free_map == NULL)
 		PANIC ("bitmap creation failed--disk is too large");
+	dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+				DISK_SECTOR_SIZE));
+	if (dirty_map == NULL)
+		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
 }
@@ -21,27 +43,67 @@ free_map_init (void) {
 /* Allocates CNT consecutive sectors from the free map and stores
  * the first into *SECTORP.
  * Returns true if successful, false if all sectors were
- * available. */
+ * available.
+ * The change reaches the free map file in free_map_sync(). */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
-		bitmap_set_multiple (free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
-	}
-	if (sector != BITMAP_ERROR)
+	disk_sector_t sector;
+
+	lock_acquire (&free_map_lock);
+	sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+	if (sector != BITMAP_ERROR) {
+		mark_dirty (sector, cnt);
 		*sectorp = sector;
+	}
+	lock_release (&free_map_lock);
 	return sector != BITMAP_ERROR;
 }
 
+/* Allocates as many of the CNT sectors starting at SECTOR as are
+ * free, up to the first one that is not.
+ * Returns the number of sectors allocated. */
+size_t
+free_map_extend (disk_sector_t sector, size_t cnt) {
+	size_t n = 0;
+
+	lock_acquire (&free_map_lock);
+	while (n < cnt && sector + n < bitmap_size (free_map)
+			&& !bitmap_test (free_map, sector + n))
+		n++;
+	if (n > 0) {
+		bitmap_set_multiple (free_map, sector, n, true);
+		mark_dirty (sector, n);
+	}
+	lock_release (&free_map_lock);
+	return n;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
+	lock_acquire (&free_map_lock);
 	ASSERT (bitmap_all (free_map, sector, cnt));
 	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+	mark_dirty (sector, cnt);
+	lock_release (&free_map_lock);
+}
+
+/* Writes the free map file sectors that changed since they were last
+ * written.  They go through the buffer cache, which takes them to
+ * disk. */
+void
+free_map_sync (void) {
+	size_t i;
+
+	lock_acquire (&free_map_lock);
+	for (i = 0; i < bitmap_size (dirty_map); i++)
+		if (bitmap_test (dirty_map, i)) {
+			if (!bitmap_write_range (free_map, free_map_file,
+						i * DISK_SECTOR_SIZE, DISK_SECTOR_SIZE))
+				PANIC ("can't write free map");
+			bitmap_reset (dirty_map, i);
+		}
+	lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -57,6 +119,7 @@ free_map_open (void) {
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) {
+	free_map_sync ();
 	file_close (free_map_file);
 }
 
@@ -74,4 +137,5 @@ free_map_create (void) {
 		PANIC ("can't open free map");
 	if (!bitmap_write (free_map, free_map_file))
 		PANIC ("can't write free map");
+	bitmap_set_all (dirty_map, false);
 }
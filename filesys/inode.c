@@ -1,23 +1,69 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
+#include <stdio.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/fat.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+#ifdef EFILESYS
 /* On-disk inode.
- * Must be exactly DISK_SECTOR_SIZE bytes long. */
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ * The file's data lives in the FAT cluster chain that starts at
+ * START. */
+struct inode_disk {
+	cluster_t start;                    /* First data cluster, or 0. */
+	off_t length;                       /* File size in bytes. */
+	unsigned magic;                     /* Magic number. */
+	uint32_t cluster_cnt;               /* Clusters in the chain. */
+	uint32_t unused[124];               /* Not used. */
+};
+
+/* Clusters between the checkpoints of an inode's skip index. */
+#define CHAIN_SKIP 16
+
+#else
+/* Extents held in the inode itself and in its indirect extent block. */
+#define INLINE_EXTENT_CNT 41
+#define INDIRECT_EXTENT_CNT 42
+#define MAX_EXTENT_CNT (INLINE_EXTENT_CNT + INDIRECT_EXTENT_CNT)
+
+/* A run of consecutive disk sectors that holds consecutive file data. */
+struct extent {
+	uint32_t first;                     /* File sector index of START. */
+	disk_sector_t start;                /* First disk sector. */
+	uint32_t cnt;                       /* Number of sectors. */
+};
+
+/* On-disk inode.
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ * The file's data is described by EXTENT_CNT extents in file order,
+ * the first INLINE_EXTENT_CNT here and the rest in the indirect
+ * extent block. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t extent_cnt;                /* Number of extents. */
+	disk_sector_t indirect;             /* Indirect extent block, or 0. */
+	struct extent extents[INLINE_EXTENT_CNT]; /* First extents. */
+	uint32_t unused[1];                 /* Not used. */
+};
+
+/* Indirect extent block.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct extent_block {
+	struct extent extents[INDIRECT_EXTENT_CNT]; /* Extents that follow. */
+	uint32_t unused[2];                 /* Not used. */
 };
+#endif
 
 /* Returns the number of sectors to allocate for an inode SIZE
  * bytes long. */
@@ -28,35 +74,390 @@ bytes_to_sectors (off_t size) {
 
 /* In-memory inode. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in open_inodes. */
 	disk_sector_t sector;               /* Sector number of disk location. */
-	int open_cnt;                       /* Number of openers. */
+	int open_cnt;                       /* Number of openers.
+	                                       Protected by open_inodes_lock. */
+	bool loading;                       /* Still being read from disk by
+	                                       its first opener.  Protected
+	                                       by open_inodes_lock. */
+	bool load_failed;                   /* Reading it failed.  Protected
+	                                       by open_inodes_lock. */
 	bool removed;                       /* True if deleted, false otherwise. */
+	struct rwlock rwlock;               /* Held for reading to use DATA,
+	                                       for writing to change its
+	                                       layout or DENY_WRITE_CNT. */
+	struct lock dir_lock;               /* Serializes directory operations,
+	                                       if a directory. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
 	struct inode_disk data;             /* Inode content. */
+#ifdef EFILESYS
+	/* Chain position cache.  Readers share it, so it has a lock of
+	 * its own. */
+	struct lock pos_lock;               /* Protects the members below. */
+	size_t pos_idx;                     /* Chain index of POS_CLST. */
+	cluster_t pos_clst;                 /* Cluster found last, or 0. */
+	cluster_t *skip;                    /* Cluster at every CHAIN_SKIP'th
+	                                       index, as far as walked. */
+	size_t skip_cnt;                    /* Checkpoints in SKIP. */
+	size_t skip_cap;                    /* Room in SKIP. */
+#else
+	struct extent_block *indirect;      /* Indirect extents, if any. */
+#endif
 };
 
+#ifdef EFILESYS
+/* Records CLST as checkpoint number SKIP_CNT of INODE's skip index,
+ * growing the index if needed.  Gives up quietly if memory runs out. */
+static void
+skip_append (struct inode *inode, cluster_t clst) {
+	if (inode->skip_cnt == inode->skip_cap) {
+		size_t cap = inode->skip_cap ? inode->skip_cap * 2 : 16;
+		cluster_t *skip = realloc (inode->skip, cap * sizeof *skip);
+		if (skip == NULL)
+			return;
+		inode->skip = skip;
+		inode->skip_cap = cap;
+	}
+	inode->skip[inode->skip_cnt++] = clst;
+}
+
+/* Returns cluster number IDX of INODE's chain, which must have more
+ * than IDX clusters.
+ * Rather than walk the chain from its head, starts from whichever is
+ * closest before IDX: the cluster the previous call found, or the
+ * nearest checkpoint of the skip index.  Checkpoints are added as the
+ * walk passes them, and the chain only ever grows at its tail, so
+ * neither goes stale while the inode is open. */
+static cluster_t
+chain_at (struct inode *inode, size_t idx) {
+	size_t pos = 0, ckpt;
+	cluster_t clst = inode->data.start;
+
+	ASSERT (idx < inode->data.cluster_cnt);
+
+	lock_acquire (&inode->pos_lock);
+	if (inode->skip_cnt == 0)
+		skip_append (inode, clst);
+	if (inode->skip_cnt > 0) {
+		ckpt = idx / CHAIN_SKIP;
+		if (ckpt >= inode->skip_cnt)
+			ckpt = inode->skip_cnt - 1;
+		pos = ckpt * CHAIN_SKIP;
+		clst = inode->skip[ckpt];
+	}
+	if (inode->pos_clst != 0 && inode->pos_idx > pos
+			&& inode->pos_idx <= idx) {
+		pos = inode->pos_idx;
+		clst = inode->pos_clst;
+	}
+
+	while (pos < idx) {
+		clst = fat_get (clst);
+		pos++;
+		if (pos % CHAIN_SKIP == 0 && pos / CHAIN_SKIP == inode->skip_cnt)
+			skip_append (inode, clst);
+	}
+
+	inode->pos_idx = idx;
+	inode->pos_clst = clst;
+	lock_release (&inode->pos_lock);
+	return clst;
+}
+
+/* Returns the number of sectors allocated to INODE. */
+static size_t
+inode_capacity (struct inode *inode) {
+	return (size_t) inode->data.cluster_cnt * SECTORS_PER_CLUSTER;
+}
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
+	size_t idx;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
+	if (pos >= inode->data.length)
+		return -1;
+
+	idx = pos / DISK_SECTOR_SIZE;
+	return cluster_to_sector (chain_at (inode, idx / SECTORS_PER_CLUSTER))
+		+ idx % SECTORS_PER_CLUSTER;
+}
+
+/* Grows INODE's data to at least SECTORS sectors, filled with zeros,
+ * by extending its cluster chain.  Returns false if the disk does not
+ * have enough free clusters, in which case INODE is unchanged.
+ * The caller writes INODE back. */
+static bool
+inode_grow (struct inode *inode, size_t sectors) {
+	static char zeros[DISK_SECTOR_SIZE];
+	struct inode_disk *data = &inode->data;
+	size_t want = DIV_ROUND_UP (sectors, SECTORS_PER_CLUSTER);
+	cluster_t last = 0, clst;
+	size_t i;
+
+	if (want <= data->cluster_cnt)
+		return true;
+
+	if (data->cluster_cnt > 0)
+		last = chain_at (inode, data->cluster_cnt - 1);
+	clst = fat_extend_chain (last, want - data->cluster_cnt);
+	if (clst == 0)
+		return false;
+	if (data->start == 0)
+		data->start = clst;
+
+	for (; data->cluster_cnt < want; data->cluster_cnt++) {
+		for (i = 0; i < SECTORS_PER_CLUSTER; i++)
+			buffer_cache_write (cluster_to_sector (clst) + i, zeros, 0,
+					DISK_SECTOR_SIZE);
+		clst = fat_get (clst);
+	}
+	return true;
+}
+
+/* Writes INODE's on-disk inode. */
+static void
+inode_write_back (struct inode *inode) {
+	buffer_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+}
+
+/* Releases the data clusters of INODE. */
+static void
+inode_release_data (struct inode *inode) {
+	if (inode->data.start != 0)
+		fat_remove_chain (inode->data.start, 0);
+}
+
+/* Starts INODE with an empty chain position cache. */
+static bool
+inode_load_meta (struct inode *inode) {
+	lock_init (&inode->pos_lock);
+	inode->pos_idx = 0;
+	inode->pos_clst = 0;
+	inode->skip = NULL;
+	inode->skip_cnt = inode->skip_cap = 0;
+	return true;
+}
+
+/* Frees INODE's skip index. */
+static void
+inode_free_meta (struct inode *inode) {
+	free (inode->skip);
+}
+#else
+/* Returns INODE's extent number I. */
+static struct extent *
+extent_at (struct inode *inode, size_t i) {
+	ASSERT (i < MAX_EXTENT_CNT);
+	if (i < INLINE_EXTENT_CNT)
+		return &inode->data.extents[i];
+	ASSERT (inode->indirect != NULL);
+	return &inode->indirect->extents[i - INLINE_EXTENT_CNT];
+}
+
+/* Returns the number of sectors allocated to INODE. */
+static size_t
+inode_capacity (struct inode *inode) {
+	struct extent *e;
+
+	if (inode->data.extent_cnt == 0)
+		return 0;
+	e = extent_at (inode, inode->data.extent_cnt - 1);
+	return e->first + e->cnt;
+}
+
+/* Returns the disk sector that contains byte offset POS within
+ * INODE.
+ * Returns -1 if INODE does not contain data for a byte at offset
+ * POS. */
+static disk_sector_t
+byte_to_sector (struct inode *inode, off_t pos) {
+	size_t idx, lo, hi;
+	struct extent *e;
+
+	ASSERT (inode != NULL);
+	if (pos >= inode->data.length)
 		return -1;
+
+	/* Binary search for the last extent that starts at or before
+	 * the sector. */
+	idx = pos / DISK_SECTOR_SIZE;
+	lo = 0;
+	hi = inode->data.extent_cnt;
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (extent_at (inode, mid)->first <= idx)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	e = extent_at (inode, lo);
+	ASSERT (idx >= e->first && idx - e->first < e->cnt);
+	return e->start + (idx - e->first);
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+/* Adds the CNT sectors starting at disk sector START to the end of
+ * INODE's data, as part of the last extent if they follow it on disk.
+ * Returns false if INODE has no room for another extent. */
+static bool
+append_run (struct inode *inode, disk_sector_t start, size_t cnt) {
+	struct inode_disk *data = &inode->data;
+	size_t first = inode_capacity (inode);
+	struct extent *e;
+
+	if (data->extent_cnt > 0) {
+		e = extent_at (inode, data->extent_cnt - 1);
+		if (e->start + e->cnt == start) {
+			e->cnt += cnt;
+			return true;
+		}
+	}
+
+	if (data->extent_cnt == MAX_EXTENT_CNT)
+		return false;
+	if (data->extent_cnt == INLINE_EXTENT_CNT) {
+		ASSERT (sizeof *inode->indirect == DISK_SECTOR_SIZE);
+		inode->indirect = calloc (1, sizeof *inode->indirect);
+		if (inode->indirect == NULL)
+			return false;
+		if (!free_map_allocate (1, &data->indirect)) {
+			free (inode->indirect);
+			inode->indirect = NULL;
+			return false;
+		}
+	}
+
+	e = extent_at (inode, data->extent_cnt++);
+	e->first = first;
+	e->start = start;
+	e->cnt = cnt;
+	return true;
+}
+
+/* Grows INODE's data to at least SECTORS sectors, filled with zeros.
+ * Tries to extend the last extent in place first, then takes the
+ * largest free runs it can find.  Returns false if the disk or INODE's
+ * extents run out, in which case INODE keeps what it did get.
+ * The caller writes INODE back. */
+static bool
+inode_grow (struct inode *inode, size_t sectors) {
+	static char zeros[DISK_SECTOR_SIZE];
+	size_t have = inode_capacity (inode);
+
+	while (have < sectors) {
+		size_t want = sectors - have;
+		size_t cnt = 0, i;
+		disk_sector_t start = 0;
+
+		if (inode->data.extent_cnt > 0) {
+			struct extent *e = extent_at (inode, inode->data.extent_cnt - 1);
+			start = e->start + e->cnt;
+			cnt = free_map_extend (start, want);
+		}
+		if (cnt == 0) {
+			for (cnt = want; cnt > 0; cnt /= 2)
+				if (free_map_allocate (cnt, &start))
+					break;
+			if (cnt == 0)
+				return false;
+		}
+		if (!append_run (inode, start, cnt)) {
+			free_map_release (start, cnt);
+			return false;
+		}
+
+		for (i = 0; i < cnt; i++)
+			buffer_cache_write (start + i, zeros, 0, DISK_SECTOR_SIZE);
+		have += cnt;
+	}
+	return true;
+}
+
+/* Writes INODE's on-disk inode and indirect extent block. */
+static void
+inode_write_back (struct inode *inode) {
+	buffer_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	if (inode->indirect != NULL)
+		buffer_cache_write (inode->data.indirect, inode->indirect, 0,
+				DISK_SECTOR_SIZE);
+}
+
+/* Releases the data sectors and indirect extent block of INODE. */
+static void
+inode_release_data (struct inode *inode) {
+	size_t i;
+
+	for (i = 0; i < inode->data.extent_cnt; i++) {
+		struct extent *e = extent_at (inode, i);
+		free_map_release (e->start, e->cnt);
+	}
+	if (inode->indirect != NULL)
+		free_map_release (inode->data.indirect, 1);
+}
+
+/* Reads INODE's indirect extent block, if it has one.
+ * Returns false if memory allocation fails. */
+static bool
+inode_load_meta (struct inode *inode) {
+	inode->indirect = NULL;
+	if (inode->data.extent_cnt > INLINE_EXTENT_CNT) {
+		inode->indirect = malloc (sizeof *inode->indirect);
+		if (inode->indirect == NULL)
+			return false;
+		buffer_cache_read (inode->data.indirect, inode->indirect, 0,
+				DISK_SECTOR_SIZE);
+	}
+	return true;
+}
+
+/* Frees the in-memory copy of INODE's indirect extent block. */
+static void
+inode_free_meta (struct inode *inode) {
+	free (inode->indirect);
+}
+#endif
+
+/* Open inodes, keyed by sector, so that opening a single inode
+ * twice returns the same `struct inode'. */
+static struct hash open_inodes;
+
+/* Protects open_inodes and every open inode's open_cnt. */
+static struct lock open_inodes_lock;
+
+/* Search key for open_inodes.  Too big for the kernel stack, so
+ * it is shared; protected by open_inodes_lock. */
+static struct inode open_inodes_key;
+
+/* Signaled, with open_inodes_lock, when an inode stops loading. */
+static struct condition inode_loaded;
+
+/* Statistics. */
+static long long open_call_cnt;         /* Calls to inode_open(). */
+static long long shared_cnt;            /* Opens of an already open inode. */
+static size_t max_open_cnt;             /* Most inodes open at once. */
+
+static uint64_t inode_hash (const struct hash_elem *, void *aux);
+static bool inode_less (const struct hash_elem *, const struct hash_elem *,
+		void *aux);
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	hash_init (&open_inodes, inode_hash, inode_less, NULL);
+	lock_init (&open_inodes_lock);
+	cond_init (&inode_loaded);
+}
+
+/* Prints open inode statistics. */
+void
+inode_print_stats (void) {
+	printf ("Inodes: %lld opens, %lld already open, %zu open at most\n",
+			open_call_cnt, shared_cnt, max_open_cnt);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -66,74 +467,116 @@ inode_init (void) {
  * Returns false if memory or disk allocation fails. */
 bool
 inode_create (disk_sector_t sector, off_t length) {
-	struct inode_disk *disk_inode = NULL;
+	struct inode *inode = NULL;
 	bool success = false;
 
 	ASSERT (length >= 0);
 
 	/* If this assertion fails, the inode structure is not exactly
 	 * one sector in size, and you should fix that. */
-	ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
-
-	disk_inode = calloc (1, sizeof *disk_inode);
-	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
-		disk_inode->length = length;
-		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
-		free (disk_inode);
+	ASSERT (sizeof inode->data == DISK_SECTOR_SIZE);
+
+	inode = calloc (1, sizeof *inode);
+	if (inode != NULL) {
+		inode->sector = sector;
+		inode->data.length = length;
+		inode->data.magic = INODE_MAGIC;
+		if (inode_grow (inode, bytes_to_sectors (length))) {
+			inode_write_back (inode);
+			success = true;
+		} else
+			inode_release_data (inode);
+		inode_free_meta (inode);
+		free (inode);
 	}
 	return success;
 }
 
 /* Reads an inode from SECTOR
  * and returns a `struct inode' that contains it.
- * Returns a null pointer if memory allocation fails. */
+ * Returns a null pointer if memory allocation fails.
+ *
+ * The first opener of SECTOR puts a placeholder, marked loading, in
+ * open_inodes and reads the inode without holding open_inodes_lock,
+ * so that opening one inode does not wait for the disk reads of
+ * another.  Racing openers of SECTOR find the placeholder and wait
+ * for it to finish loading. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
+	struct hash_elem *e;
 	struct inode *inode;
+	bool loaded;
+
+	lock_acquire (&open_inodes_lock);
+	open_call_cnt++;
 
 	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
+	open_inodes_key.sector = sector;
+	e = hash_find (&open_inodes, &open_inodes_key.elem);
+	if (e != NULL) {
+		inode = hash_entry (e, struct inode, elem);
+		inode->open_cnt++;
+		shared_cnt++;
+		while (inode->loading)
+			cond_wait (&inode_loaded, &open_inodes_lock);
+		if (inode->load_failed) {
+			if (--inode->open_cnt == 0)
+				free (inode);
+			inode = NULL;
 		}
+		lock_release (&open_inodes_lock);
+		return inode;
 	}
 
 	/* Allocate memory. */
 	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	if (inode == NULL) {
+		lock_release (&open_inodes_lock);
 		return NULL;
+	}
 
-	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
+	/* Initialize, and publish the placeholder. */
 	inode->sector = sector;
 	inode->open_cnt = 1;
+	inode->loading = true;
+	inode->load_failed = false;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	rwlock_init (&inode->rwlock);
+	lock_init (&inode->dir_lock);
+	hash_insert (&open_inodes, &inode->elem);
+	if (hash_size (&open_inodes) > max_open_cnt)
+		max_open_cnt = hash_size (&open_inodes);
+	lock_release (&open_inodes_lock);
+
+	/* Read it. */
+	buffer_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	loaded = inode_load_meta (inode);
+
+	/* Wake up the racing openers.  On failure, the last of them
+	 * frees the placeholder. */
+	lock_acquire (&open_inodes_lock);
+	inode->loading = false;
+	if (!loaded) {
+		inode->load_failed = true;
+		hash_delete (&open_inodes, &inode->elem);
+		if (--inode->open_cnt == 0)
+			free (inode);
+		inode = NULL;
+	}
+	cond_broadcast (&inode_loaded, &open_inodes_lock);
+	lock_release (&open_inodes_lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+	}
 	return inode;
 }
 
@@ -148,22 +591,34 @@ inode_get_inumber (const struct inode *inode) {
  * If INODE was also a removed inode, frees its blocks. */
 void
 inode_close (struct inode *inode) {
+	bool last;
+
 	/* Ignore null pointer. */
 	if (inode == NULL)
 		return;
 
-	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
+	/* Drop our reference.  The last closer removes the inode from
+	 * open_inodes before releasing the lock, so no opener can find
+	 * it afterward. */
+	lock_acquire (&open_inodes_lock);
+	last = --inode->open_cnt == 0;
+	if (last)
+		hash_delete (&open_inodes, &inode->elem);
+	lock_release (&open_inodes_lock);
 
+	/* Release resources if this was the last opener. */
+	if (last) {
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
+#ifdef EFILESYS
+			fat_remove_chain (sector_to_cluster (inode->sector), 0);
+#else
 			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+#endif
+			inode_release_data (inode);
 		}
 
+		inode_free_meta (inode);
 		free (inode); 
 	}
 }
@@ -183,15 +638,15 @@ off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
+	rwlock_acquire_read (&inode->rwlock);
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
+		off_t inode_left = inode->data.length - offset;
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
 		int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -200,45 +655,58 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		/* Copy the chunk out of the buffer cache. */
+		buffer_cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
+	rwlock_release_read (&inode->rwlock);
 
 	return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if the disk fills up or an error occurs.
+ * A write past end of file extends the inode, and any gap between
+ * the old end of file and OFFSET reads back as zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
-
+	bool extend;
+
+	/* A write past end of file changes INODE's length and layout, so
+	 * it keeps everyone else out until its data is in place.  Other
+	 * writes only change data, which the buffer cache keeps consistent
+	 * sector by sector, so they share the lock with readers.  Files
+	 * never shrink, so a write found within the file stays so. */
+	extend = size > 0 && offset + size > inode_length (inode);
+	if (extend)
+		rwlock_acquire_write (&inode->rwlock);
+	else
+		rwlock_acquire_read (&inode->rwlock);
 	if (inode->deny_write_cnt)
-		return 0;
+		goto done;
+
+	if (size > 0 && offset + size > inode->data.length) {
+		/* Extend INODE to cover the write, as far as the disk allows. */
+		off_t end = offset + size;
+		off_t capacity;
+
+		inode_grow (inode, bytes_to_sectors (end));
+		capacity = (off_t) inode_capacity (inode) * DISK_SECTOR_SIZE;
+		if (end > capacity)
+			end = capacity;
+		if (end > inode->data.length)
+			inode->data.length = end;
+		inode_write_back (inode);
+	}
 
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
@@ -246,7 +714,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
+		off_t inode_left = inode->data.length - offset;
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
 		int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -255,45 +723,50 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		/* Copy the chunk into the buffer cache, which reads in the rest
+		 * of the sector first if the chunk does not cover it. */
+		buffer_cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
 
+done:
+	if (extend)
+		rwlock_release_write (&inode->rwlock);
+	else
+		rwlock_release_read (&inode->rwlock);
 	return bytes_written;
 }
 
+/* Queues up to CNT sectors of INODE's data for read-ahead, starting
+ * with the sector that holds byte offset OFFSET.  Returns the offset
+ * just past the data queued. */
+off_t
+inode_readahead (struct inode *inode, off_t offset, size_t cnt) {
+	off_t length;
+
+	rwlock_acquire_read (&inode->rwlock);
+	length = inode->data.length;
+	offset = ROUND_DOWN (offset, DISK_SECTOR_SIZE);
+	for (; cnt > 0 && offset < length; cnt--, offset += DISK_SECTOR_SIZE)
+		buffer_cache_readahead (byte_to_sector (inode, offset));
+	rwlock_release_read (&inode->rwlock);
+	return offset < length ? offset : length;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 	void
 inode_deny_write (struct inode *inode) 
 {
+	rwlock_acquire_write (&inode->rwlock);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -301,13 +774,43 @@ inode_deny_write (struct inode *inode)
  * inode_deny_write() on the inode, before closing the inode. */
 void
 inode_allow_write (struct inode *inode) {
+	rwlock_acquire_write (&inode->rwlock);
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	rwlock_release_write (&inode->rwlock);
 }
 
-/* Returns the length, in bytes, of INODE's data. */
+/* Returns the length, in bytes, of INODE's data.
+ * Needs no lock: the length is read in one access and only grows. */
 off_t
 inode_length (const struct inode *inode) {
 	return inode->data.length;
 }
+
+/* Acquires INODE's directory lock, which serializes operations on
+ * the directory INODE holds.  It is separate from the lock on
+ * INODE's data, which those operations take as they read and write
+ * entries. */
+void
+inode_lock_dir (struct inode *inode) {
+	lock_acquire (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock. */
+void
+inode_unlock_dir (struct inode *inode) {
+	lock_release (&inode->dir_lock);
+}
+
+static uint64_t
+inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
+}
@@ -0,0 +1,26 @@
+#ifndef FILESYS_BUFFER_CACHE_H
+#define FILESYS_BUFFER_CACHE_H
+
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "devices/disk.h"
+
+/* Default number of sectors the buffer cache holds. */
+#define BUFFER_CACHE_DEFAULT_SIZE 64
+
+/* Smallest read-ahead window, in sectors. */
+#define READAHEAD_MIN_WINDOW 4
+
+/* -bc: Number of sectors the buffer cache holds. */
+extern size_t buffer_cache_size;
+
+void buffer_cache_init (void);
+void buffer_cache_read (disk_sector_t, void *, off_t ofs, size_t size);
+void buffer_cache_write (disk_sector_t, const void *, off_t ofs, size_t size);
+void buffer_cache_readahead (disk_sector_t);
+size_t buffer_cache_readahead_limit (void);
+void buffer_cache_flush (void);
+void buffer_cache_done (void);
+void buffer_cache_print_stats (void);
+
+#endif /* filesys/buffer_cache.h */
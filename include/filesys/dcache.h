@@ -0,0 +1,26 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+/* Most names the directory entry cache holds. */
+#define DCACHE_SIZE 256
+
+/* Result of a directory entry cache lookup. */
+enum dcache_result {
+	DCACHE_MISS,                /* Not cached. */
+	DCACHE_POSITIVE,            /* Cached, and the name exists. */
+	DCACHE_NEGATIVE             /* Cached, and the name does not exist. */
+};
+
+void dcache_init (void);
+enum dcache_result dcache_lookup (disk_sector_t dir, const char *name,
+		disk_sector_t *inode_sector);
+void dcache_enter (disk_sector_t dir, const char *name,
+		disk_sector_t inode_sector);
+void dcache_enter_negative (disk_sector_t dir, const char *name);
+void dcache_invalidate_dir (disk_sector_t dir);
+void dcache_print_stats (void);
+
+#endif /* filesys/dcache.h */
@@ -21,6 +21,7 @@ typedef uint32_t cluster_t;  /* Index of a cluster within FAT. */
 void fat_init (void);
 void fat_open (void);
 void fat_close (void);
+void fat_sync (void);
 void fat_create (void);
 void fat_close (void);
 
@@ -31,8 +32,11 @@ void fat_remove_chain (
     cluster_t clst, /* Cluster # to be removed */
     cluster_t pclst /* Previous cluster of clst, 0: clst is the start of chain */
 );
+cluster_t fat_extend_chain (cluster_t clst, size_t cnt);
 cluster_t fat_get (cluster_t clst);
 void fat_put (cluster_t clst, cluster_t val);
 disk_sector_t cluster_to_sector (cluster_t clst);
+cluster_t sector_to_cluster (disk_sector_t sector);
+void fat_print_stats (void);
 
 #endif /* filesys/fat.h */
@@ -10,8 +10,10 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+void free_map_sync (void);
 
 bool free_map_allocate (size_t, disk_sector_t *);
+size_t free_map_extend (disk_sector_t, size_t);
 void free_map_release (disk_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
@@ -2,6 +2,7 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/disk.h"
 
@@ -16,8 +17,12 @@ void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_readahead (struct inode *, off_t offset, size_t cnt);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+void inode_lock_dir (struct inode *);
+void inode_unlock_dir (struct inode *);
+void inode_print_stats (void);
 
 #endif /* filesys/inode.h */
@@ -50,6 +50,25 @@ static __inline uint64_t rcr3(void) {
 	return val;
 }
 
+__attribute__((always_inline))
+static __inline uint64_t rcr0(void) {
+	uint64_t val;
+	__asm __volatile("movq %%cr0,%0" : "=r" (val));
+	return val;
+}
+
+__attribute__((always_inline))
+static __inline void lcr0(uint64_t val) {
+	__asm __volatile("movq %0, %%cr0" : : "r" (val));
+}
+
+__attribute__((always_inline))
+static __inline uint64_t rdtsc(void) {
+	uint32_t lo, hi;
+	__asm __volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+
 __attribute__((always_inline))
 static __inline uint64_t rrax(void) {
 	uint64_t val;
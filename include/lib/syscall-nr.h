@@ -36,6 +36,12 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Virtual memory extensions. */
+	SYS_MSYNC,                  /* Write a memory mapping back to its file. */
+	SYS_MADVISE,                /* Advise on the use of a memory range. */
+	SYS_MEMSTAT,                /* Report the memory use of the process. */
+	SYS_MEMLIMIT,               /* Cap the resident memory of the process. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -13,6 +13,41 @@ typedef int pid_t;
 typedef int off_t;
 #define MAP_FAILED ((void *)NULL)
 
+/* Flags that may be or'ed into the WRITABLE argument of mmap(). */
+#define MAP_SHARED 0x100    /* Shared with forked children, not copied. */
+#define MAP_ANONYMOUS 0x200 /* Zero-filled memory; FD and OFFSET unused. */
+
+/* Advice for madvise(). */
+#define MADV_NORMAL 0       /* No special treatment. */
+#define MADV_RANDOM 1       /* Expect random accesses: no read-ahead. */
+#define MADV_SEQUENTIAL 2   /* Expect sequential accesses. */
+#define MADV_WILLNEED 3     /* Prefetch the range now. */
+#define MADV_DONTNEED 4     /* Release the range's memory now. */
+
+/* Page fault types, for get_fault_cnt(), numbered like enum
+   vm_fault_type. */
+#define FAULT_MINOR 0       /* Mapped without reading anything. */
+#define FAULT_MAJOR 1       /* Read from a file or the swap disk. */
+#define FAULT_ZERO 2        /* Read fault mapped to the shared zero page. */
+#define FAULT_COW 3         /* Write to a read-only mapping. */
+#define FAULT_STACK 4       /* Grew the stack. */
+#define FAULT_INVALID 5     /* Not resolved; the process dies. */
+#define FAULT_TYPE_CNT 6
+
+/* Buckets of the fault latency histogram, for get_fault_hist().  Bucket
+   I counts faults that took [2^I, 2^(I+1)) TSC cycles. */
+#define FAULT_HIST_BUCKETS 24
+
+/* Memory use of a process, in pages, as reported by memstat(). */
+struct memstat {
+	size_t rss;         /* Resident frames, not counting the zero page. */
+	size_t swap;        /* Pages in swap or the compressed pool. */
+	size_t page_tables; /* Page-table pages, including the PML4. */
+	size_t fdt;         /* Pages of the file descriptor table. */
+	size_t open_files;  /* Open file descriptors. */
+	size_t rss_limit;   /* Cap set by memlimit(), 0 if none. */
+};
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -41,6 +76,10 @@ int dup2(int oldfd, int newfd);
 /* Project 3 and optionally project 4. */
 void *mmap(void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap(void *addr);
+int msync(void *addr);
+int madvise(void *addr, size_t length, int advice);
+int memstat(struct memstat *stat);
+int memlimit(size_t rss_pages);
 
 /* Project 4 only. */
 bool chdir(const char *dir);
@@ -81,4 +120,31 @@ get_fs_disk_write_cnt(void)
 	return write_cnt;
 }
 
+/* Returns a page fault statistic of this process, or of the whole
+   system if SYSTEM: with LATENCY false, the number of faults of type
+   IDX; with LATENCY true, the number in latency bucket IDX. */
+static inline long long
+get_fault_stat(bool system, bool latency, unsigned idx)
+{
+	long long cnt;
+	asm volatile("int $0x45"
+				 : "=a"(cnt)
+				 : "a"((long long)latency), "c"((long long)idx),
+				   "d"((long long)system)
+				 : "memory");
+	return cnt;
+}
+
+static inline long long
+get_fault_cnt(int type)
+{
+	return get_fault_stat(false, false, type);
+}
+
+static inline long long
+get_fault_hist(int bucket)
+{
+	return get_fault_stat(false, true, bucket);
+}
+
 #endif /* lib/user/syscall.h */
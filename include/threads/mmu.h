@@ -2,6 +2,7 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
@@ -10,6 +11,7 @@ typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
 uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
+size_t pml4_table_cnt (uint64_t *pml4);
 void pml4_destroy (uint64_t *pml4);
 void pml4_activate (uint64_t *pml4);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
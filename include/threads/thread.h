@@ -147,6 +147,19 @@ struct thread
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	/* NOTE: [3.3] 시스템 콜 진입 시점의 유저 rsp (커널 모드 page fault의 스택 확장 판단용) */
+	void *user_rsp;
+	/* NOTE: [3.4] 아직 파일에 쓰이지 않은 mmap 페이지 수 (쓰기 스로틀링 기준) */
+	int mmap_dirty_cnt;
+	/* NOTE: [3.4] 프로세스가 사용 중인 프레임 수와 스왑된 페이지 수 (OOM 희생자 선정 기준) */
+	size_t rss_cnt;
+	size_t swap_cnt;
+	/* NOTE: [3.4] memlimit()으로 설정한 프레임 수 상한 (0이면 제한 없음), 넘으면 자기 페이지부터 회수 */
+	size_t rss_limit;
+	/* NOTE: [3.4] OOM killer에게 선택되어 종료되어야 하는 프로세스 표시 */
+	bool oom_killed;
+	/* NOTE: [3.4] 페이지 폴트 종류별 횟수와 처리 시간(TSC) 히스토그램 */
+	struct fault_stats fault_stats;
 #endif
 
 	/* Owned by thread.c. */
@@ -168,6 +181,10 @@ void thread_print_stats(void);
 typedef void thread_func(void *aux);
 tid_t thread_create(const char *name, int priority, thread_func *, void *);
 
+/* Performs some operation on thread t, given auxiliary data AUX. */
+typedef void thread_action_func(struct thread *t, void *aux);
+void thread_foreach(thread_action_func *, void *);
+
 void thread_block(void);
 void thread_unblock(struct thread *);
 
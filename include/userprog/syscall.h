@@ -2,8 +2,6 @@
 #define USERPROG_SYSCALL_H
 
 void syscall_init(void);
-
-/* NOTE: [2.4] File에 대한 동시 접근을 막기 위한 filesys_lock 추가 */
-struct lock filesys_lock;
+void exit(int status);
 
 #endif /* userprog/syscall.h */
@@ -4,10 +4,24 @@
 struct page;
 enum vm_type;
 
+struct zswap_entry;
+
+/* An evicted anonymous page lives in exactly one of three places: the
+ * zero flag, the compressed pool, or a swap slot. */
 struct anon_page {
+	size_t slot;                /* Swap slot holding the page, if evicted. */
+	struct zswap_entry *zswap;  /* Compressed copy, if evicted. */
+	bool zero;                  /* Evicted while all zero. */
+	bool readahead;             /* Being loaded by swap read-ahead. */
+	bool writing;               /* Moving from the pool to SLOT. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_adopt (struct page *page);
+bool anon_is_zero (struct page *page);
+void anon_clear_zero (struct page *page);
+size_t anon_swap_out_cluster (struct page *pages[], size_t cnt);
+void swap_print_stats (void);
 
 #endif
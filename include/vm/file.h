@@ -6,12 +6,37 @@
 struct page;
 enum vm_type;
 
+/* Where a lazily loaded page comes from: READ_BYTES bytes of FILE at
+ * OFS, followed by ZERO_BYTES zero bytes.  Passed as the AUX of the
+ * uninit page for ELF segments and file mappings. */
+struct lazy_load_info {
+	struct file *file;
+	off_t ofs;
+	size_t read_bytes;
+	size_t zero_bytes;
+};
+
 struct file_page {
+	struct file *file;          /* Mapped file, owned by the region. */
+	off_t ofs;                  /* Offset of this page in FILE. */
+	size_t read_bytes;          /* Bytes backed by FILE, rest is zero. */
+	bool segment;               /* Executable segment page (VM_SEGMENT). */
+	bool dirty;                 /* Written since last written back. */
+	bool flushing;              /* The flusher holds a copy not yet
+	                               written.  Protected by the flusher's
+	                               lock. */
 };
 
 void vm_file_init (void);
 bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
+bool file_lazy_load (struct page *page, void *aux);
+bool file_segment_pos (struct page *page, struct inode **inode, off_t *ofs,
+		size_t *read_bytes);
+void file_set_dirty (struct page *page);
+void file_throttle_dirty (void);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+bool do_msync (void *addr);
+void file_print_stats (void);
 #endif
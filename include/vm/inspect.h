@@ -1,4 +1,5 @@
 #ifndef _VM_INSPECT_H_
 #define _VM_INSPECT_H_
 void register_inspect_intr (void);
+void register_fault_inspect_intr (void);
 #endif
@@ -0,0 +1,15 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+#include <stddef.h>
+
+struct frame;
+
+/* -ksm: Frames the same-page scanner examines per pass, 0 if off. */
+extern size_t ksm_pages_to_scan;
+
+void ksm_init (void);
+void ksm_forget (struct frame *frame);
+void ksm_note_split (void);
+void ksm_print_stats (void);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef VM_LZ_H
+#define VM_LZ_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Entries in the match table that lz_compress() works in. */
+#define LZ_HASH_SIZE 1024
+
+/* Longest input lz_compress() accepts. */
+#define LZ_MAX_INPUT 4096
+
+size_t lz_compress (const void *src, size_t len, void *dst, size_t cap,
+		uint16_t table[LZ_HASH_SIZE]);
+bool lz_decompress (const void *src, size_t len, void *dst, size_t dst_len);
+
+#endif
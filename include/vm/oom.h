@@ -0,0 +1,9 @@
+#ifndef VM_OOM_H
+#define VM_OOM_H
+
+void oom_init (void);
+void oom_check_watermark (void);
+void oom_kill (void);
+void oom_print_stats (void);
+
+#endif
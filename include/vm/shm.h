@@ -0,0 +1,36 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+#include <stddef.h>
+#include "threads/synch.h"
+#include "vm/vm.h"
+
+struct page;
+enum vm_type;
+
+/* Anonymous memory shared by every process that maps it, the creator
+ * and its forked children.  Each page of the object has a master page,
+ * an anonymous page that no process maps: while resident its FRAME is
+ * the frame all processes map, and once evicted it holds the swap state
+ * like any anonymous page. */
+struct shm_object {
+	struct lock lock;           /* Serializes loads, teardown and REF_CNT. */
+	int ref_cnt;                /* Regions that map the object. */
+	size_t page_cnt;
+	struct page *pages[];       /* Master page of each page. */
+};
+
+/* A process's page of a shared memory object. */
+struct shm_page {
+	struct shm_object *obj;
+	size_t idx;                 /* Index of the page in OBJ. */
+};
+
+bool shm_initializer (struct page *page, enum vm_type type, void *kva);
+bool shm_load (struct page *page, void *aux);
+struct shm_object *shm_locate (struct page *page, size_t *idx);
+struct page *shm_master (struct page *page);
+struct shm_object *shm_get (struct shm_object *obj);
+void shm_put (struct shm_object *obj);
+void shm_release (struct page *page);
+void *do_mmap_anon (void *addr, size_t length, bool writable, bool shared);
+#endif
@@ -1,6 +1,8 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <hash.h>
+#include <list.h>
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -12,6 +14,8 @@ enum vm_type {
 	VM_FILE = 2,
 	/* page that hold the page cache, for project 4 */
 	VM_PAGE_CACHE = 3,
+	/* page of anonymous memory shared between processes */
+	VM_SHM = 4,
 
 	/* Bit flags to store state */
 
@@ -27,6 +31,8 @@ enum vm_type {
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
+#include "vm/shm.h"
+#include "vm/ksm.h"
 #ifdef EFILESYS
 #include "filesys/page_cache.h"
 #endif
@@ -36,6 +42,14 @@ struct thread;
 
 #define VM_TYPE(type) ((type) & 7)
 
+/* Marks the anonymous pages that make up the user stack. */
+#define VM_STACK VM_MARKER_0
+
+/* Marks the file pages of an executable's segments.  Their frames are
+ * shared by every process running the executable, and writes go to a
+ * private anonymous copy instead of the file. */
+#define VM_SEGMENT VM_MARKER_1
+
 /* The representation of "page".
  * This is kind of "parent class", which has four "child class"es, which are
  * uninit_page, file_page, anon_page, and page cache (project4).
@@ -46,6 +60,10 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct hash_elem spt_elem;  /* Element in supplemental_page_table.pages. */
+	bool writable;              /* May the user process write this page? */
+	struct thread *owner;       /* Process whose pml4 maps this page. */
+	struct list_elem frame_elem; /* Element in frame->pages. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -53,6 +71,7 @@ struct page {
 		struct uninit_page uninit;
 		struct anon_page anon;
 		struct file_page file;
+		struct shm_page shm;
 #ifdef EFILESYS
 		struct page_cache page_cache;
 #endif
@@ -62,7 +81,25 @@ struct page {
 /* The representation of "frame" */
 struct frame {
 	void *kva;
-	struct page *page;
+	struct page *page;          /* First of PAGES, or NULL if none. */
+	struct list pages;          /* Pages sharing this frame copy-on-write. */
+	struct list_elem elem;      /* Element in the global frame table. */
+	unsigned pin_cnt;           /* Excluded from eviction while nonzero. */
+	bool evicting;              /* Being written to swap, with frame_lock
+	                               released. */
+
+	/* File position of the contents, for frames in the segment cache.
+	 * SEG_INODE is null for other frames. */
+	struct hash_elem seg_elem;  /* Element in the segment cache. */
+	struct inode *seg_inode;
+	off_t seg_ofs;
+	size_t seg_bytes;
+
+	/* Frames merged by the same-page scanner, mapped read-only by every
+	 * page, are hashed by KSM_SUM in its stable table. */
+	struct hash_elem ksm_elem;  /* Element in the stable table. */
+	bool ksm;                   /* In the stable table? */
+	uint64_t ksm_sum;           /* Checksum of the contents. */
 };
 
 /* The function table for page operations.
@@ -81,10 +118,82 @@ struct page_operations {
 #define destroy(page) \
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
+/* The stack may grow down to USER_STACK - STACK_MAX. */
+#define STACK_MAX (1 << 20)
+
+/* Kinds of virtual memory regions. */
+enum vm_region_kind {
+	REGION_SEGMENT,             /* PT_LOAD segment of the executable. */
+	REGION_STACK,               /* User stack, including room to grow. */
+	REGION_MMAP,                /* Mapping created by mmap(). */
+};
+
+/* Access patterns and actions for vm_madvise(), numbered like the
+ * MADV_* constants of lib/user/syscall.h.  A region remembers the last
+ * access pattern it was given. */
+enum vm_advice {
+	VM_ADV_NORMAL,              /* Adaptive read-ahead. */
+	VM_ADV_RANDOM,              /* No fault-around or read-ahead. */
+	VM_ADV_SEQUENTIAL,          /* Full read-ahead, drop pages behind. */
+	VM_ADV_WILLNEED,            /* Prefetch the range now. */
+	VM_ADV_DONTNEED,            /* Release the range's memory now. */
+};
+
+/* Kinds of page fault, numbered like the FAULT_* constants of
+ * lib/user/syscall.h. */
+enum vm_fault_type {
+	VM_FAULT_MINOR,             /* Mapped without reading anything. */
+	VM_FAULT_MAJOR,             /* Read from a file or the swap disk. */
+	VM_FAULT_ZERO,              /* Read fault mapped to the zero frame. */
+	VM_FAULT_COW,               /* Write to a read-only mapping. */
+	VM_FAULT_STACK,             /* Grew the stack. */
+	VM_FAULT_INVALID,           /* Not resolved; the process dies. */
+	VM_FAULT_TYPE_CNT
+};
+
+/* Buckets of a fault latency histogram.  Bucket I counts faults that
+ * took [2^I, 2^(I+1)) TSC cycles; the last one also counts slower ones. */
+#define FAULT_HIST_BUCKETS 24
+
+/* Page fault statistics of one process. */
+struct fault_stats {
+	uint32_t cnt[VM_FAULT_TYPE_CNT];        /* Faults by type. */
+	uint32_t hist[FAULT_HIST_BUCKETS];      /* Faults by latency. */
+};
+
+/* A contiguous run of pages [START, END) that share one backing object.
+ * Regions are the interval index of the supplemental page table: range
+ * operations (munmap, overlap checks, stack growth) work on regions and
+ * only touch the per-page hash for the pages they actually cover. */
+struct vm_region {
+	void *start;                /* First page of the region. */
+	void *end;                  /* One past the last page of the region. */
+	enum vm_region_kind kind;
+	bool writable;
+	struct file *file;          /* Backing file, owned by the region. */
+	off_t offset;               /* File offset that START maps to. */
+	struct shm_object *shm;     /* Shared memory behind it, or null. */
+	enum vm_advice advice;      /* Access pattern from madvise(). */
+	struct list_elem elem;      /* Element in supplemental_page_table.regions. */
+	struct vm_region *left;     /* Children in the region tree. */
+	struct vm_region *right;
+
+	/* Read-ahead state.  While faults follow each other through the
+	 * region, each one loads RA_WINDOW further pages. */
+	void *ra_next;              /* Where a sequential fault would land. */
+	size_t ra_run;              /* Sequential faults in a row. */
+	size_t ra_window;           /* Pages to read ahead, 0 if random. */
+};
+
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ * PAGES hashes every page by its page-aligned user address, so a fault
+ * resolves in O(1).  REGIONS is kept sorted by start address, for walks
+ * in order, and REGION_ROOT holds the same regions in a balanced search
+ * tree, so that finding the region of an address takes O(log n). */
 struct supplemental_page_table {
+	struct hash pages;          /* struct page, keyed by va. */
+	struct list regions;        /* struct vm_region, sorted by start. */
+	struct vm_region *region_root; /* Region tree, keyed by start. */
 };
 
 #include "threads/thread.h"
@@ -92,10 +201,20 @@ void supplemental_page_table_init (struct supplemental_page_table *spt);
 bool supplemental_page_table_copy (struct supplemental_page_table *dst,
 		struct supplemental_page_table *src);
 void supplemental_page_table_kill (struct supplemental_page_table *spt);
+void supplemental_page_table_destroy (struct supplemental_page_table *spt);
 struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+struct vm_region *spt_add_region (struct supplemental_page_table *spt,
+		void *start, void *end, enum vm_region_kind kind, bool writable,
+		struct file *file, off_t offset);
+struct vm_region *spt_find_region (struct supplemental_page_table *spt,
+		const void *va);
+bool spt_range_is_free (struct supplemental_page_table *spt,
+		const void *start, const void *end);
+void spt_remove_region (struct supplemental_page_table *spt,
+		struct vm_region *region);
 
 void vm_init (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
@@ -108,5 +227,23 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
 enum vm_type page_get_type (struct page *page);
+void vm_free_frame (struct page *page);
+void vm_free_shared_frame (struct page *page, bool keep);
+void vm_free_master_frame (struct page *master);
+bool vm_pin_page (struct page *page);
+void vm_unpin_page (struct page *page);
+bool vm_prefetch_page (struct page *page);
+bool vm_madvise (void *addr, size_t length, enum vm_advice advice);
+void vm_for_each_frame (bool (*func) (struct frame *, void *), void *aux);
+bool vm_frame_is_mergeable (struct frame *frame);
+void vm_protect_frame (struct frame *frame);
+void vm_merge_frame (struct frame *dup, struct frame *into);
+bool vm_reclaim_frame (void);
+uint64_t vm_fault_stat (bool system, bool latency, unsigned idx);
+void vm_print_fault_stats (void);
+void vm_print_stats (void);
+
+/* -pfstat: Print each process's fault statistics when it exits? */
+extern bool vm_fault_stats_on_exit;
 
 #endif  /* VM_VM_H */
@@ -155,6 +155,26 @@ munmap (void *addr) {
 	syscall1 (SYS_MUNMAP, addr);
 }
 
+int
+msync (void *addr) {
+	return syscall1 (SYS_MSYNC, addr);
+}
+
+int
+madvise (void *addr, size_t length, int advice) {
+	return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int
+memstat (struct memstat *stat) {
+	return syscall1 (SYS_MEMSTAT, stat);
+}
+
+int
+memlimit (size_t rss_pages) {
+	return syscall1 (SYS_MEMLIMIT, rss_pages);
+}
+
 bool
 chdir (const char *dir) {
 	return syscall1 (SYS_CHDIR, dir);
@@ -0,0 +1,53 @@
+/* Child process for syn-scale-bench test.
+   Writes its own file a block at a time, then reads it back
+   ROUND_CNT times and checks each block. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/syn-scale-bench.h"
+
+const char *test_name = "child-syn-scale";
+
+static char buf[FILE_SIZE];
+static char block[BLOCK_SIZE];
+
+int
+main (int argc, const char *argv[])
+{
+  char name[16];
+  int child_idx;
+  int fd, round;
+  size_t ofs;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (name, sizeof name, "file%d", child_idx);
+
+  random_init (child_idx);
+  random_bytes (buf, sizeof buf);
+
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  for (ofs = 0; ofs < sizeof buf; ofs += BLOCK_SIZE)
+    CHECK (write (fd, buf + ofs, BLOCK_SIZE) == BLOCK_SIZE,
+           "write %d bytes at offset %zu in \"%s\"", BLOCK_SIZE, ofs, name);
+
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      seek (fd, 0);
+      for (ofs = 0; ofs < sizeof buf; ofs += BLOCK_SIZE)
+        {
+          CHECK (read (fd, block, BLOCK_SIZE) == BLOCK_SIZE,
+                 "read %d bytes at offset %zu in \"%s\"",
+                 BLOCK_SIZE, ofs, name);
+          compare_bytes (block, buf + ofs, BLOCK_SIZE, ofs, name);
+        }
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,61 @@
+/* Appends to one file 4 kB at a time until the disk is full,
+   deletes it and fills the disk again, so that nearly every free
+   cluster is allocated twice, one append at a time.  The kernel
+   reports how many of the allocated clusters were contiguous and how
+   often the allocator searched its free-cluster bitmap in its "FAT:"
+   statistics line at shutdown. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK 4096
+
+static char buf[CHUNK];
+static char block[CHUNK];
+
+static size_t
+fill_disk (const char *file_name)
+{
+  size_t total = 0;
+  int fd, n;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  do
+    {
+      n = write (fd, buf, CHUNK);
+      total += n;
+    }
+  while (n == CHUNK);
+  if (total < CHUNK)
+    fail ("wrote only %zu bytes to \"%s\"", total, file_name);
+
+  seek (fd, 0);
+  if (read (fd, block, CHUNK) != CHUNK)
+    fail ("could not read back \"%s\"", file_name);
+  compare_bytes (block, buf, CHUNK, 0, file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  return total;
+}
+
+void
+test_main (void)
+{
+  size_t first, second;
+
+  memset (buf, 0x5a, sizeof buf);
+
+  msg ("fill disk");
+  first = fill_disk ("bench");
+  CHECK (remove ("bench"), "remove \"bench\"");
+
+  msg ("fill disk again");
+  second = fill_disk ("bench");
+  CHECK (remove ("bench"), "remove \"bench\"");
+
+  if (first != second)
+    fail ("first pass wrote %zu bytes, second pass %zu", first, second);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-fill-bench) begin
+(lg-fill-bench) fill disk
+(lg-fill-bench) create "bench"
+(lg-fill-bench) open "bench"
+(lg-fill-bench) close "bench"
+(lg-fill-bench) remove "bench"
+(lg-fill-bench) fill disk again
+(lg-fill-bench) create "bench"
+(lg-fill-bench) open "bench"
+(lg-fill-bench) close "bench"
+(lg-fill-bench) remove "bench"
+(lg-fill-bench) end
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Creates many small files, checks their sizes and deletes them
+   again.  Each creation and deletion allocates or frees an inode
+   sector and a few data sectors, so updates to the free map (or FAT)
+   dominate.  The kernel's disk statistics at shutdown show how many
+   sectors all of that wrote. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+#define FILE_SIZE 1234
+
+void
+test_main (void)
+{
+  char name[16];
+  int i;
+
+  msg ("create %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!create (name, FILE_SIZE))
+        fail ("create \"%s\" failed", name);
+    }
+
+  msg ("check file sizes");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      int fd;
+
+      snprintf (name, sizeof name, "file%d", i);
+      if ((fd = open (name)) < 2)
+        fail ("open \"%s\" failed", name);
+      if (filesize (fd) != FILE_SIZE)
+        fail ("\"%s\" is %d bytes, not %d", name, filesize (fd), FILE_SIZE);
+      close (fd);
+    }
+
+  msg ("remove %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\" failed", name);
+    }
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-create-bench) begin
+(sm-create-bench) create 200 files
+(sm-create-bench) check file sizes
+(sm-create-bench) remove 200 files
+(sm-create-bench) end
+EOF
+pass;
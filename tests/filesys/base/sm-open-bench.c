@@ -0,0 +1,58 @@
+/* Creates thousands of empty files, keeps a batch of them open, and
+   opens and closes every file while the batch stays open.  Each open
+   looks up the file's inode among the inodes already open, so the
+   cost of that lookup dominates once many inodes are open.  The
+   kernel's inode statistics at shutdown show how many opens there
+   were and how many found their inode already open. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 2000
+#define HELD_CNT 100
+#define ROUND_CNT 2
+
+static int held[HELD_CNT];
+
+void
+test_main (void)
+{
+  char name[16];
+  int i, round;
+
+  msg ("create %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+
+  msg ("hold %d files open", HELD_CNT);
+  for (i = 0; i < HELD_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if ((held[i] = open (name)) < 2)
+        fail ("open \"%s\" failed", name);
+    }
+
+  msg ("open and close %d files %d times", FILE_CNT, ROUND_CNT);
+  for (round = 0; round < ROUND_CNT; round++)
+    for (i = 0; i < FILE_CNT; i++)
+      {
+        int fd;
+
+        snprintf (name, sizeof name, "file%d", i);
+        if ((fd = open (name)) < 2)
+          fail ("open \"%s\" failed", name);
+        if (filesize (fd) != 0)
+          fail ("\"%s\" is %d bytes, not 0", name, filesize (fd));
+        close (fd);
+      }
+
+  msg ("close %d files", HELD_CNT);
+  for (i = 0; i < HELD_CNT; i++)
+    close (held[i]);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-open-bench) begin
+(sm-open-bench) create 2000 files
+(sm-open-bench) hold 100 files open
+(sm-open-bench) open and close 2000 files 2 times
+(sm-open-bench) close 100 files
+(sm-open-bench) end
+EOF
+pass;
@@ -0,0 +1,31 @@
+/* Spawns child processes that each write a file of their own and
+   then read it back and check it, all at the same time.  Together
+   the files are much larger than the buffer cache, so the children
+   wait on the disk a lot; the less the file system serializes them,
+   the more one child's disk I/O overlaps with the others' work.  The
+   kernel's timer statistics at shutdown show how long that took. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/syn-scale-bench.h"
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  char name[16];
+  int i;
+
+  msg ("create %d files", CHILD_CNT);
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!create (name, FILE_SIZE))
+        fail ("create \"%s\" failed", name);
+    }
+
+  exec_children ("child-syn-scale", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-scale-bench) begin
+(syn-scale-bench) create 8 files
+(syn-scale-bench) exec child 1 of 8: "child-syn-scale 0"
+(syn-scale-bench) exec child 2 of 8: "child-syn-scale 1"
+(syn-scale-bench) exec child 3 of 8: "child-syn-scale 2"
+(syn-scale-bench) exec child 4 of 8: "child-syn-scale 3"
+(syn-scale-bench) exec child 5 of 8: "child-syn-scale 4"
+(syn-scale-bench) exec child 6 of 8: "child-syn-scale 5"
+(syn-scale-bench) exec child 7 of 8: "child-syn-scale 6"
+(syn-scale-bench) exec child 8 of 8: "child-syn-scale 7"
+(syn-scale-bench) wait for child 1 of 8 returned 0 (expected 0)
+(syn-scale-bench) wait for child 2 of 8 returned 1 (expected 1)
+(syn-scale-bench) wait for child 3 of 8 returned 2 (expected 2)
+(syn-scale-bench) wait for child 4 of 8 returned 3 (expected 3)
+(syn-scale-bench) wait for child 5 of 8 returned 4 (expected 4)
+(syn-scale-bench) wait for child 6 of 8 returned 5 (expected 5)
+(syn-scale-bench) wait for child 7 of 8 returned 6 (expected 6)
+(syn-scale-bench) wait for child 8 of 8 returned 7 (expected 7)
+(syn-scale-bench) end
+EOF
+pass;
@@ -0,0 +1,9 @@
+#ifndef TESTS_FILESYS_BASE_SYN_SCALE_BENCH_H
+#define TESTS_FILESYS_BASE_SYN_SCALE_BENCH_H
+
+#define CHILD_CNT 8
+#define FILE_SIZE 32768
+#define BLOCK_SIZE 512
+#define ROUND_CNT 2
+
+#endif /* tests/filesys/base/syn-scale-bench.h */
@@ -0,0 +1,48 @@
+/* Forks a process with a 4 MB .bss whose pages are all resident,
+   several times over.  With copy-on-write the children share the
+   parent's frames, so fork cost does not grow with the .bss.  The
+   kernel reports the average cost of a fork in its "VM:" statistics
+   line at shutdown. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 1024
+#define CHILD_CNT 8
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+  int c;
+
+  msg ("touch %d pages", PAGE_CNT);
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = i;
+
+  msg ("fork %d children", CHILD_CNT);
+  for (c = 0; c < CHILD_CNT; c++)
+    {
+      pid_t child = fork ("child");
+      if (child == 0)
+        {
+          /* Read one page and write another, as a child that goes on
+             to exec would touch only a few pages. */
+          if (buf[c * PAGE_SIZE] != (char) c)
+            exit (1);
+          buf[(c + 1) * PAGE_SIZE] = 0;
+          exit (0);
+        }
+      if (wait (child) != 0)
+        fail ("child %d saw the wrong data", c);
+    }
+
+  msg ("check parent data");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (buf[i * PAGE_SIZE] != (char) i)
+      fail ("page %zu holds %d", i, buf[i * PAGE_SIZE]);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cow-fork-bench) begin
+(cow-fork-bench) touch 1024 pages
+(cow-fork-bench) fork 8 children
+(cow-fork-bench) check parent data
+(cow-fork-bench) end
+EOF
+pass;
@@ -0,0 +1,72 @@
+/* Makes faults of each kind and checks that the kernel counts them,
+   and that every fault lands in one bucket of the latency
+   histogram. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+static char buf[16 * PAGE_SIZE];
+
+/* Touches 8 pages of stack below the current stack pointer. */
+static void NO_INLINE
+grow_stack (void)
+{
+  char stack_obj[8 * PAGE_SIZE];
+
+  memset (stack_obj, 1, sizeof stack_obj);
+  asm volatile ("" : : "r" (stack_obj) : "memory");
+}
+
+/* Returns the number of faults of all types so far. */
+static long long
+total_faults (void)
+{
+  long long total = 0;
+  int type;
+
+  for (type = 0; type < FAULT_TYPE_CNT; type++)
+    total += get_fault_cnt (type);
+  return total;
+}
+
+void
+test_main (void)
+{
+  long long before, total = 0;
+  volatile char c;
+  char *map = (char *) 0x10000000;
+  int bucket, handle;
+
+  before = get_fault_cnt (FAULT_ZERO);
+  c = buf[0];
+  CHECK (get_fault_cnt (FAULT_ZERO) > before, "read fault maps the zero page");
+
+  before = get_fault_cnt (FAULT_COW);
+  buf[0] = 1;
+  CHECK (get_fault_cnt (FAULT_COW) > before, "write fault copies it");
+
+  before = get_fault_cnt (FAULT_STACK);
+  grow_stack ();
+  CHECK (get_fault_cnt (FAULT_STACK) > before, "stack growth is counted");
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (map, PAGE_SIZE, 0, handle, 0) != MAP_FAILED, "mmap \"sample.txt\"");
+  before = get_fault_cnt (FAULT_MAJOR);
+  c = map[0];
+  CHECK (get_fault_cnt (FAULT_MAJOR) > before, "file read is a major fault");
+  munmap (map);
+  close (handle);
+
+  /* Count first: calling total_faults() may fault its code in. */
+  before = total_faults ();
+  for (bucket = 0; bucket < FAULT_HIST_BUCKETS; bucket++)
+    total += get_fault_hist (bucket);
+  CHECK (total == before, "histogram holds every fault");
+  CHECK (get_fault_stat (true, false, FAULT_COW) >= get_fault_cnt (FAULT_COW),
+         "system counts include this process");
+  (void) c;
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fault-stats) begin
+(fault-stats) read fault maps the zero page
+(fault-stats) write fault copies it
+(fault-stats) stack growth is counted
+(fault-stats) open "sample.txt"
+(fault-stats) mmap "sample.txt"
+(fault-stats) file read is a major fault
+(fault-stats) histogram holds every fault
+(fault-stats) system counts include this process
+(fault-stats) end
+EOF
+pass;
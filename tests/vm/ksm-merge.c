@@ -0,0 +1,66 @@
+/* Fills many pages with the same bytes and waits for the same-page
+   scanner to merge them into one frame, then writes each page, which
+   should split it off again without disturbing the others. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 128
+#define MAX_ROUNDS 500
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+/* Returns true once every page of BUF maps the same frame. */
+static bool
+all_merged (void)
+{
+  void *pa = get_phys_addr (&buf[0]);
+  size_t i;
+
+  for (i = 1; i < PAGE_CNT; i++)
+    if (get_phys_addr (&buf[i * PAGE_SIZE]) != pa)
+      return false;
+  return true;
+}
+
+void
+test_main (void)
+{
+  char block[512];
+  int round;
+  size_t i;
+
+  msg ("fill %d pages", PAGE_CNT);
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = 0x5a;
+
+  /* Block on the disk, so that the scanner gets to run. */
+  for (round = 0; round < MAX_ROUNDS && !all_merged (); round++)
+    {
+      int fd = open ("sample.txt");
+      if (fd < 0)
+        fail ("open \"sample.txt\" failed");
+      while (read (fd, block, sizeof block) > 0)
+        continue;
+      close (fd);
+    }
+  CHECK (all_merged (), "check pages share one frame");
+
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = i;
+  for (i = 1; i < PAGE_CNT; i++)
+    if (get_phys_addr (&buf[i * PAGE_SIZE]) == get_phys_addr (&buf[0]))
+      fail ("page %d still shares a frame after a write", (int) i);
+  msg ("check written pages split off");
+
+  for (i = 0; i < sizeof buf; i++)
+    {
+      char expected = i % PAGE_SIZE == 0 ? (char) (i / PAGE_SIZE) : 0x5a;
+      if (buf[i] != expected)
+        fail ("byte %d is %d, expected %d", (int) i, buf[i], expected);
+    }
+  msg ("check memory content");
+}
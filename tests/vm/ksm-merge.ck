@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(ksm-merge) begin
+(ksm-merge) fill 128 pages
+(ksm-merge) check pages share one frame
+(ksm-merge) check written pages split off
+(ksm-merge) check memory content
+(ksm-merge) end
+EOF
+pass;
@@ -0,0 +1,46 @@
+/* Gives madvise() each kind of advice: access patterns and WILLNEED
+   for a file mapping that is read afterwards, and DONTNEED for a file
+   mapping, which must read back from the file, and for anonymous
+   memory, which must read back as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_MAP ((char *) 0x10000000)
+#define ANON_MAP ((char *) 0x20000000)
+#define ANON_SIZE (16 * 4096)
+
+void
+test_main (void)
+{
+  int handle;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (FILE_MAP, 4096, 0, handle, 0) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  CHECK (madvise (FILE_MAP, 4096, MADV_SEQUENTIAL) == 0, "advise sequential");
+  CHECK (madvise (FILE_MAP, 4096, MADV_WILLNEED) == 0, "advise willneed");
+  if (memcmp (FILE_MAP, sample, strlen (sample)))
+    fail ("read of mapped file is incorrect");
+  CHECK (madvise (FILE_MAP, 4096, MADV_RANDOM) == 0, "advise random");
+  CHECK (madvise (FILE_MAP, 4096, MADV_DONTNEED) == 0,
+         "advise dontneed on file mapping");
+  if (memcmp (FILE_MAP, sample, strlen (sample)))
+    fail ("read of mapped file after DONTNEED is incorrect");
+
+  CHECK (mmap (ANON_MAP, ANON_SIZE, 1 | MAP_ANONYMOUS, -1, 0) != MAP_FAILED,
+         "mmap anonymous");
+  memset (ANON_MAP, 0x5a, ANON_SIZE);
+  CHECK (madvise (ANON_MAP, ANON_SIZE, MADV_DONTNEED) == 0,
+         "advise dontneed on anonymous mapping");
+  for (i = 0; i < ANON_SIZE; i++)
+    if (ANON_MAP[i] != 0)
+      fail ("byte %d is %d after DONTNEED", (int) i, ANON_MAP[i]);
+
+  CHECK (madvise (ANON_MAP + ANON_SIZE, 4096, MADV_WILLNEED) == -1,
+         "advise unmapped range");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt"
+(madvise) advise sequential
+(madvise) advise willneed
+(madvise) advise random
+(madvise) advise dontneed on file mapping
+(madvise) mmap anonymous
+(madvise) advise dontneed on anonymous mapping
+(madvise) advise unmapped range
+(madvise) end
+EOF
+pass;
@@ -0,0 +1,51 @@
+/* Checks the numbers memstat() reports as the process touches memory,
+   then caps its resident memory with memlimit() and checks that
+   touching more pages makes it swap its own pages out instead of
+   growing. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 128
+#define LIMIT 48
+
+/* Slack for pages mapped without a frame of their own, such as shared
+   code pages brought in by fault-around. */
+#define SLACK 16
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  struct memstat before, after;
+  size_t i;
+
+  CHECK (memstat (&before) == 0, "memstat");
+  CHECK (before.rss > 0 && before.page_tables > 1 && before.fdt == 1
+         && before.rss_limit == 0, "check initial numbers");
+
+  for (i = 0; i < PAGE_CNT / 2; i++)
+    buf[i * PAGE_SIZE] = i + 1;
+  CHECK (memstat (&after) == 0, "memstat");
+  CHECK (after.rss >= before.rss + PAGE_CNT / 2,
+         "check %d written pages are resident", PAGE_CNT / 2);
+
+  CHECK (memlimit (LIMIT) == 0, "memlimit (%d)", LIMIT);
+  for (i = PAGE_CNT / 2; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = i + 1;
+  CHECK (memstat (&after) == 0, "memstat");
+  CHECK (after.rss_limit == LIMIT, "check limit is reported");
+  if (after.rss > LIMIT + SLACK)
+    fail ("%zu pages resident over a limit of %d", after.rss, LIMIT);
+  CHECK (after.swap > 0, "check pages went to swap");
+
+  for (i = 0; i < PAGE_CNT; i++)
+    if (buf[i * PAGE_SIZE] != (char) (i + 1))
+      fail ("page %zu lost its contents", i);
+  msg ("check memory content");
+  CHECK (memlimit (0) == 0, "memlimit (0)");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(memstat) begin
+(memstat) memstat
+(memstat) check initial numbers
+(memstat) memstat
+(memstat) check 64 written pages are resident
+(memstat) memlimit (48)
+(memstat) memstat
+(memstat) check limit is reported
+(memstat) check pages went to swap
+(memstat) check memory content
+(memstat) memlimit (0)
+(memstat) end
+EOF
+pass;
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-msync) begin
+(mmap-msync) create "sample.txt"
+(mmap-msync) open "sample.txt"
+(mmap-msync) mmap "sample.txt"
+(mmap-msync) msync "sample.txt"
+(mmap-msync) compare read data against written data
+(mmap-msync) msync unmapped address
+(mmap-msync) end
+EOF
+pass;
@@ -0,0 +1,28 @@
+/* Touches every page of a 4 MB zero-filled array once, so that
+   each touch is a fresh page fault, then reads the pages back.
+   The kernel reports the average cost of a fault in its "VM:"
+   statistics line at shutdown. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 1024
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  msg ("fault in %d pages", PAGE_CNT);
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = i;
+
+  msg ("read back");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (buf[i * PAGE_SIZE] != (char) i)
+      fail ("page %zu holds %d", i, buf[i * PAGE_SIZE]);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fault-bench) begin
+(page-fault-bench) fault in 1024 pages
+(page-fault-bench) read back
+(page-fault-bench) end
+EOF
+pass;
@@ -0,0 +1,89 @@
+/* Streams 1 MB from a forked child to its parent through a ring
+   buffer in a shared anonymous mapping.  Once the ring's pages are
+   resident, a transfer takes no system call or page fault, so the
+   run time of the test measures the bandwidth of shared memory. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define RING ((void *) 0x10000000)
+#define BLOCK_SIZE 4096
+#define SLOT_CNT 16
+#define BLOCK_CNT 256
+
+/* Keeps the compiler from moving memory accesses across it. */
+#define barrier() asm volatile ("" : : : "memory")
+
+struct ring
+  {
+    volatile unsigned head;     /* Blocks written by the child. */
+    volatile unsigned tail;     /* Blocks consumed by the parent. */
+    uint8_t pad[BLOCK_SIZE - 2 * sizeof (unsigned)];
+    uint8_t slots[SLOT_CNT][BLOCK_SIZE];
+  };
+
+static uint8_t
+pattern (unsigned block, size_t ofs)
+{
+  return (block * 31 + ofs) & 0xff;
+}
+
+static void
+produce (struct ring *ring)
+{
+  unsigned b;
+  size_t i;
+
+  for (b = 0; b < BLOCK_CNT; b++)
+    {
+      uint8_t *slot = ring->slots[b % SLOT_CNT];
+
+      while (ring->head - ring->tail == SLOT_CNT)
+        continue;
+      for (i = 0; i < BLOCK_SIZE; i++)
+        slot[i] = pattern (b, i);
+      barrier ();
+      ring->head = b + 1;
+    }
+}
+
+void
+test_main (void)
+{
+  struct ring *ring;
+  size_t bad = 0;
+  pid_t child;
+  unsigned b;
+  size_t i;
+
+  CHECK ((ring = mmap (RING, sizeof *ring,
+                       1 | MAP_SHARED | MAP_ANONYMOUS, -1, 0)) != MAP_FAILED,
+         "mmap shared ring");
+
+  msg ("stream %d blocks", BLOCK_CNT);
+  child = fork ("producer");
+  if (child == 0)
+    {
+      produce (ring);
+      exit (0);
+    }
+
+  for (b = 0; b < BLOCK_CNT; b++)
+    {
+      const uint8_t *slot = ring->slots[b % SLOT_CNT];
+
+      while (ring->head == b)
+        continue;
+      barrier ();
+      for (i = 0; i < BLOCK_SIZE; i++)
+        if (slot[i] != pattern (b, i))
+          bad++;
+      barrier ();
+      ring->tail = b + 1;
+    }
+  CHECK (bad == 0, "check received data");
+  CHECK (wait (child) == 0, "wait for producer");
+  munmap (ring);
+}
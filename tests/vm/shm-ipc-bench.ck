@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(shm-ipc-bench) begin
+(shm-ipc-bench) mmap shared ring
+(shm-ipc-bench) stream 256 blocks
+(shm-ipc-bench) check received data
+(shm-ipc-bench) wait for producer
+(shm-ipc-bench) end
+EOF
+pass;
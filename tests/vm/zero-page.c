@@ -0,0 +1,38 @@
+/* Reads a large .bss array that is never written, which should map
+   every page to the same read-only frame of zeros, then writes one
+   page, which should give that page a frame of its own. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 512
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  void *zero_pa;
+  size_t i;
+
+  msg ("read %d pages", PAGE_CNT);
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 0)
+      fail ("byte %d is %d", (int) i, buf[i]);
+
+  zero_pa = get_phys_addr (&buf[0]);
+  CHECK (zero_pa != 0, "check first page is mapped");
+  for (i = 1; i < PAGE_CNT; i++)
+    if (get_phys_addr (&buf[i * PAGE_SIZE]) != zero_pa)
+      fail ("page %d has a frame of its own", (int) i);
+  msg ("check pages share one frame");
+
+  buf[PAGE_SIZE] = 1;
+  CHECK (get_phys_addr (&buf[PAGE_SIZE]) != zero_pa,
+         "check written page left the shared frame");
+  CHECK (buf[PAGE_SIZE] == 1 && buf[0] == 0 && buf[2 * PAGE_SIZE] == 0,
+         "check memory content");
+}
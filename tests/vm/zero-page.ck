@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(zero-page) begin
+(zero-page) read 512 pages
+(zero-page) check first page is mapped
+(zero-page) check pages share one frame
+(zero-page) check written page left the shared frame
+(zero-page) check memory content
+(zero-page) end
+EOF
+pass;
@@ -31,11 +31,19 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "intrinsic.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/buffer_cache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
+#endif
+
+#ifdef VM
+#define CR0_WP 0x00010000      /* Write-Protect enable in kernel mode. */
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -165,6 +173,11 @@ paging_init (uint64_t mem_end) {
 
 	// reload cr3
 	pml4_activate(0);
+#ifdef VM
+	// Make kernel writes honor read-only user pages too, so that they
+	// fault on pages shared copy-on-write.
+	lcr0 (rcr0 () | CR0_WP);
+#endif
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -216,6 +229,8 @@ parse_options (char **argv) {
 #ifdef FILESYS
 		else if (!strcmp (name, "-f"))
 			format_filesys = true;
+		else if (!strcmp (name, "-bc"))
+			buffer_cache_size = atoi (value);
 #endif
 		else if (!strcmp (name, "-rs"))
 			random_init (atoi (value));
@@ -226,6 +241,12 @@ parse_options (char **argv) {
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-ksm"))
+			ksm_pages_to_scan = atoi (value);
+		else if (!strcmp (name, "-pfstat"))
+			vm_fault_stats_on_exit = true;
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -324,10 +345,18 @@ usage (void) {
 			"  -h                 Print this help message and power off.\n"
 			"  -q                 Power off VM after actions or on panic.\n"
 			"  -f                 Format file system disk during startup.\n"
+#ifdef FILESYS
+			"  -bc=SECTORS        Cache SECTORS disk sectors (default 64).\n"
+#endif
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -ksm=PAGES         Merge identical user pages, scanning PAGES\n"
+			"                     frames every 100 ms.\n"
+			"  -pfstat            Print fault statistics of exiting processes.\n"
 #endif
 			);
 	power_off ();
@@ -356,10 +385,19 @@ print_stats (void) {
 	thread_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	buffer_cache_print_stats ();
+	dcache_print_stats ();
+	inode_print_stats ();
+#ifdef EFILESYS
+	fat_print_stats ();
+#endif
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
+#ifdef VM
+	vm_print_stats ();
+#endif
 }
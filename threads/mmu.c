@@ -155,6 +155,34 @@ pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	return true;
 }
 
+/* Returns the number of pages PML4 uses for page tables, including
+ * PML4 itself but not the kernel tables it shares with base_pml4. */
+size_t
+pml4_table_cnt (uint64_t *pml4) {
+	size_t cnt = 1;
+
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
+		uint64_t *pdp;
+
+		if (!(pml4[i] & PTE_P) || pml4[i] == base_pml4[i])
+			continue;
+		pdp = ptov (PTE_ADDR (pml4[i]));
+		cnt++;
+		for (unsigned j = 0; j < PGSIZE / sizeof(uint64_t *); j++) {
+			uint64_t *pd;
+
+			if (!(pdp[j] & PTE_P))
+				continue;
+			pd = ptov (PTE_ADDR (pdp[j]));
+			cnt++;
+			for (unsigned k = 0; k < PGSIZE / sizeof(uint64_t *); k++)
+				if (pd[k] & PTE_P)
+					cnt++;
+		}
+	}
+	return cnt;
+}
+
 static void
 pt_destroy (uint64_t *pt) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
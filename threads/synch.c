@@ -440,6 +440,87 @@ void cond_broadcast(struct condition *cond, struct lock *lock)
 		cond_signal(cond, lock);
 }
 
+/* Initializes RW as a readers-writer lock.  Any number of threads
+   may hold it for reading at once, or a single thread for
+   writing.  Waiting writers go first: once a writer waits, new
+   readers wait behind it, so that a steady stream of readers
+   cannot starve it.
+
+   Neither mode is recursive.  A thread that holds RW in either
+   mode must not acquire it again. */
+void rwlock_init(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	lock_init(&rw->lock);
+	cond_init(&rw->readers_ok);
+	cond_init(&rw->writers_ok);
+	rw->readers = 0;
+	rw->writers_waiting = 0;
+	rw->writer = NULL;
+}
+
+/* Acquires RW for reading, sleeping until no thread writes or
+   waits to write. */
+void rwlock_acquire_read(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(!intr_context());
+	ASSERT(rw->writer != thread_current());
+
+	lock_acquire(&rw->lock);
+	while (rw->writer != NULL || rw->writers_waiting > 0)
+		cond_wait(&rw->readers_ok, &rw->lock);
+	rw->readers++;
+	lock_release(&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void rwlock_release_read(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	lock_acquire(&rw->lock);
+	ASSERT(rw->readers > 0);
+	if (--rw->readers == 0)
+		cond_signal(&rw->writers_ok, &rw->lock);
+	lock_release(&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no other thread reads
+   or writes. */
+void rwlock_acquire_write(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(!intr_context());
+	ASSERT(rw->writer != thread_current());
+
+	lock_acquire(&rw->lock);
+	rw->writers_waiting++;
+	while (rw->writer != NULL || rw->readers > 0)
+		cond_wait(&rw->writers_ok, &rw->lock);
+	rw->writers_waiting--;
+	rw->writer = thread_current();
+	lock_release(&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for writing.  The
+   next waiting writer goes first; if there is none, every waiting
+   reader enters. */
+void rwlock_release_write(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	lock_acquire(&rw->lock);
+	ASSERT(rw->writer == thread_current());
+	rw->writer = NULL;
+	if (rw->writers_waiting > 0)
+		cond_signal(&rw->writers_ok, &rw->lock);
+	else
+		cond_broadcast(&rw->readers_ok, &rw->lock);
+	lock_release(&rw->lock);
+}
+
 /**
  * @brief 두 쓰레드의 우선순위를 비교하는 함수
  *
@@ -948,6 +948,21 @@ void thread_all_calc_recent_cpu()
 	}
 }
 
+/* NOTE: [3.4] `모든` 쓰레드에 대해 FUNC를 호출하는 함수 구현 (OOM killer의 희생자 선정용)
+ * 인터럽트가 꺼진 상태에서 호출해야 함 */
+void thread_foreach(thread_action_func *func, void *aux)
+{
+	struct list_elem *e;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e))
+	{
+		struct thread *t = list_entry(e, struct thread, all_elem);
+		func(t, aux);
+	}
+}
+
 /* NOTE: [2.3] 자식 프로세스 검색 함수 구현 */
 struct thread *get_child_process(tid_t tid)
 {
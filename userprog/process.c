@@ -173,6 +173,8 @@ __do_fork(void *aux)
 
 	process_activate(current);
 #ifdef VM
+	/* NOTE: [3.4] 메모리 상한은 자식에게 상속 */
+	current->rss_limit = parent->rss_limit;
 	supplemental_page_table_init(&current->spt);
 	if (!supplemental_page_table_copy(&current->spt, &parent->spt))
 		goto error;
@@ -239,10 +241,8 @@ int process_exec(void *f_name) /* NOTE: 강의의 start_process() */
 	/* We first kill the current context */
 	process_cleanup();
 
-	lock_acquire(&filesys_lock);
 	/* And then load the binary */
 	success = load(file_name, &_if);
-	lock_release(&filesys_lock);
 
 	/* NOTE: [2.3] 메모리 적재 완료 시 부모 프로세스 다시 진행 (세마포어 이용) */
 	// sema_up(&thread_current()->load_sema);
@@ -356,7 +356,16 @@ void process_exit(void)
 	for (int idx = 2; idx < FDT_MAX; idx++)
 		file_close(process_get_file(idx));
 	palloc_free_page(curr->fdt);
+#ifdef VM
+	/* NOTE: [3.4] -pfstat 옵션이 주어지면 종료하는 프로세스의 페이지 폴트 통계 출력 */
+	if (vm_fault_stats_on_exit && curr->pml4 != NULL)
+		vm_print_fault_stats();
+#endif
 	process_cleanup();
+#ifdef VM
+	/* NOTE: [3.1] process_cleanup()이 비운 spt의 해시 테이블 해제 (exec은 비우기만 하고 재사용) */
+	supplemental_page_table_destroy(&curr->spt);
+#endif
 
 	/* NOTE: [2.3] thread_exit 수정 */
 	/* 부모 프로세스를 대기 상태에서 이탈시킴 (세마포어 이용) */
@@ -779,14 +788,6 @@ install_page(void *upage, void *kpage, bool writable)
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-static bool
-lazy_load_segment(struct page *page, void *aux)
-{
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
-}
-
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
@@ -809,6 +810,32 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT(pg_ofs(upage) == 0);
 	ASSERT(ofs % PGSIZE == 0);
 
+	/* NOTE: [3.2] 앞 세그먼트와 첫 페이지를 공유하는 경우 (예: ELF 헤더 세그먼트와 text)
+	 * 뒤 세그먼트가 같은 파일 페이지를 모두 읽으므로 앞 세그먼트의 페이지를 넘겨받음 */
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	struct vm_region *prev = spt_find_region(spt, upage);
+	if (prev != NULL && prev->kind == REGION_SEGMENT && prev->start == (void *)upage
+		&& prev->end == (void *)(upage + PGSIZE))
+	{
+		struct page *page = spt_find_page(spt, upage);
+		if (page != NULL)
+			spt_remove_page(spt, page);
+		spt_remove_region(spt, prev);
+	}
+
+	/* NOTE: [3.2] 세그먼트 전체를 하나의 region으로 등록, region이 파일을 소유 */
+	struct vm_region *region;
+	struct file *seg_file = file_reopen(file);
+	if (seg_file == NULL)
+		return false;
+	region = spt_add_region(spt, upage, upage + read_bytes + zero_bytes,
+							REGION_SEGMENT, writable, seg_file, ofs);
+	if (region == NULL)
+	{
+		file_close(seg_file);
+		return false;
+	}
+
 	while (read_bytes > 0 || zero_bytes > 0)
 	{
 		/* Do calculate how to fill this page.
@@ -817,16 +844,36 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer(VM_ANON, upage,
-											writable, lazy_load_segment, aux))
-			return false;
+		/* NOTE: [3.2] 파일 내용이 있는 페이지는 VM_SEGMENT 파일 페이지로 만들어
+		 * 같은 실행 파일을 돌리는 프로세스끼리 프레임을 공유, 쓰기 시 anon으로 복사됨.
+		 * 내용이 전부 0인 페이지(.bss)는 그냥 anon 페이지 */
+		if (page_read_bytes == 0)
+		{
+			if (!vm_alloc_page(VM_ANON, upage, writable))
+				return false;
+		}
+		else
+		{
+			struct lazy_load_info *aux = malloc(sizeof *aux);
+			if (aux == NULL)
+				return false;
+			aux->file = seg_file;
+			aux->ofs = ofs;
+			aux->read_bytes = page_read_bytes;
+			aux->zero_bytes = page_zero_bytes;
+			if (!vm_alloc_page_with_initializer(VM_FILE | VM_SEGMENT, upage,
+												writable, file_lazy_load, aux))
+			{
+				free(aux);
+				return false;
+			}
+		}
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
 		upage += PGSIZE;
+		ofs += page_read_bytes;
 	}
 	return true;
 }
@@ -838,10 +885,17 @@ setup_stack(struct intr_frame *if_)
 	bool success = false;
 	void *stack_bottom = (void *)(((uint8_t *)USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
+	/* NOTE: [3.3] 스택이 자랄 수 있는 범위 전체를 region으로 예약 */
+	if (spt_add_region(&thread_current()->spt, (void *)(USER_STACK - STACK_MAX),
+					   (void *)USER_STACK, REGION_STACK, true, NULL, 0) == NULL)
+		return false;
+
+	/* NOTE: [3.2] 스택 첫 페이지를 바로 할당하고 rsp 설정 */
+	if (vm_alloc_page(VM_ANON | VM_STACK, stack_bottom, true) && vm_claim_page(stack_bottom))
+	{
+		success = true;
+		if_->rsp = USER_STACK;
+	}
 
 	return success;
 }
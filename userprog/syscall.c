@@ -1,5 +1,6 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <round.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -10,12 +11,18 @@
 /* NOTE: [2.2] 구현에 필요한 라이브러리 include */
 #include "threads/init.h"
 #include "filesys/filesys.h"
+#include "filesys/directory.h"
 #include "lib/string.h"
 #include "lib/syscall-nr.h"
 #include "lib/user/syscall.h"
 #include "userprog/process.h"
 #include "devices/input.h"
 #include "threads/palloc.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
 
 void syscall_entry(void);
 void syscall_handler(struct intr_frame *);
@@ -36,6 +43,8 @@ void syscall_handler(struct intr_frame *);
 /* NOTE: [2.2] define */
 #define USER_AREA_STAR 0x8048000
 #define USER_AREA_END 0xc0000000
+/* NOTE: [4.3] 커널 페이지를 얻지 못했을 때 read/write가 대신 쓰는 커널 스택 버퍼 크기 */
+#define IO_CHUNK_MIN 512
 
 /* process */
 void halt(void);
@@ -55,7 +64,20 @@ void close(int fd);
 bool create(const char *file, unsigned initial_size);
 bool remove(const char *file);
 
+#ifdef VM
+/* memory mapping */
+void *mmap(void *addr, size_t length, int writable, int fd, off_t offset);
+void munmap(void *addr);
+int msync(void *addr);
+int madvise(void *addr, size_t length, int advice);
+int memstat(struct memstat *stat);
+int memlimit(size_t rss_pages);
+#endif
+
 void check_address(void *addr);
+void check_buffer(const void *buffer, unsigned size, bool writable);
+bool copy_in_string(char *dst, const char *ustr, size_t size);
+static int file_io(struct file *file, void *buffer, unsigned size, bool write);
 
 void syscall_init(void)
 {
@@ -68,9 +90,6 @@ void syscall_init(void)
 	 * mode stack. Therefore, we masked the FLAG_FL. */
 	write_msr(MSR_SYSCALL_MASK,
 			  FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
-
-	/* NOTE: [2.4] filesys_lock 초기화 */
-	lock_init(&filesys_lock);
 }
 
 /* The main system call interface */
@@ -79,6 +98,13 @@ void syscall_handler(struct intr_frame *f)
 	// NOTE: [2.X] Your implementation goes here.
 	/* TODO: [2.5] fork 추가 */
 	uint64_t syscall_num = f->R.rax;
+#ifdef VM
+	/* NOTE: [3.3] 커널 모드 page fault에서 스택 확장을 판단하기 위해 유저 rsp 저장 */
+	thread_current()->user_rsp = (void *)f->rsp;
+	/* NOTE: [3.4] OOM killer에게 선택된 프로세스는 다음 시스템 콜에서 종료 */
+	if (thread_current()->oom_killed)
+		exit(-1);
+#endif
 
 	switch (syscall_num)
 	{
@@ -124,6 +150,26 @@ void syscall_handler(struct intr_frame *f)
 	case SYS_CLOSE: // 13
 		close(f->R.rdi);
 		break;
+#ifdef VM
+	case SYS_MMAP: // 14
+		f->R.rax = (uint64_t)mmap((void *)f->R.rdi, f->R.rsi, f->R.rdx, f->R.r10, f->R.r8);
+		break;
+	case SYS_MUNMAP: // 15
+		munmap((void *)f->R.rdi);
+		break;
+	case SYS_MSYNC:
+		f->R.rax = msync((void *)f->R.rdi);
+		break;
+	case SYS_MADVISE:
+		f->R.rax = madvise((void *)f->R.rdi, f->R.rsi, f->R.rdx);
+		break;
+	case SYS_MEMSTAT:
+		f->R.rax = memstat((void *)f->R.rdi);
+		break;
+	case SYS_MEMLIMIT:
+		f->R.rax = memlimit(f->R.rdi);
+		break;
+#endif
 	}
 }
 
@@ -181,13 +227,13 @@ int wait(pid_t pid)
 /* NOTE: [2.2] 파일을 생성하는 시스템 콜*/
 bool create(const char *file, unsigned initial_size)
 {
-	check_address(file);
+	char name[NAME_MAX + 2];
+	if (!copy_in_string(name, file, sizeof name))
+		return false;
 
 	bool success;
-	lock_acquire(&filesys_lock);
 	/* 파일 이름과 크기에 해당하는 파일 생성*/
-	success = filesys_create(file, initial_size);
-	lock_release(&filesys_lock);
+	success = filesys_create(name, initial_size);
 	/* 파일 생성 성공 시 true 반환, 실패 시 false 반환 */
 	return success;
 }
@@ -195,13 +241,13 @@ bool create(const char *file, unsigned initial_size)
 /* NOTE: [2.2] 파일을 삭제하는 시스템 콜 */
 bool remove(const char *file)
 {
-	check_address(file);
+	char name[NAME_MAX + 2];
+	if (!copy_in_string(name, file, sizeof name))
+		return false;
 
 	bool success;
-	lock_acquire(&filesys_lock);
 	/* 파일 이름에 해당하는 파일을 제거*/
-	success = filesys_remove(file);
-	lock_release(&filesys_lock);
+	success = filesys_remove(name);
 	/* 파일 제거 성공 시 true 반환, 실패 시 false 반환 */
 	return success;
 }
@@ -209,11 +255,12 @@ bool remove(const char *file)
 /* NOTE: [2.4] open() 시스템 콜 구현 */
 int open(const char *file_name)
 {
-	check_address(file_name);
-	lock_acquire(&filesys_lock);
+	char name[NAME_MAX + 2];
+	if (!copy_in_string(name, file_name, sizeof name))
+		return -1;
 	/* 파일을 open */
 	int fd = -1;
-	struct file *file = filesys_open(file_name);
+	struct file *file = filesys_open(name);
 
 	/* 해당 파일 객체에 파일 디스크립터 부여*/
 	/* 파일 디스크립터 리턴*/
@@ -221,7 +268,6 @@ int open(const char *file_name)
 		fd = process_add_file(file);
 	if (fd == -1)
 		file_close(file);
-	lock_release(&filesys_lock);
 
 	/* 해당 파일이 존재하지 않으면 -1 리턴 */
 	return fd;
@@ -230,7 +276,6 @@ int open(const char *file_name)
 /* NOTE: [2.4] filesize() 시스템 콜 구현 */
 int filesize(int fd)
 {
-	lock_acquire(&filesys_lock);
 	/* 파일 디스크립터를 이용하여 파일 객체 검색 */
 	struct file *file = process_get_file(fd);
 	int size = -1;
@@ -238,7 +283,6 @@ int filesize(int fd)
 	if (file != NULL)
 		size = file_length(file);
 
-	lock_release(&filesys_lock);
 	/* 해당 파일이 존재하지 않으면 -1 리턴 */
 	return size;
 }
@@ -248,8 +292,6 @@ int read(int fd, void *buffer, unsigned size)
 {
 	check_address(buffer);
 
-	/* 파일에 동시 접근이 일어날 수 있으므로 Lock 사용 */
-	lock_acquire(&filesys_lock);
 	/* 파일 디스크립터를 이용하여 파일 객체 검색 */
 	struct file *file = process_get_file(fd);
 	/* 파일 디스크립터가 0일 경우 키보드에 입력을 버퍼에 저장 후 버퍼의 저장한 크기를 리턴 (input_getc() 이용) */
@@ -257,17 +299,15 @@ int read(int fd, void *buffer, unsigned size)
 	{
 		uint8_t user_input = input_getc();
 		memcpy(buffer, &user_input, sizeof(user_input));
-		lock_release(&filesys_lock);
 		return sizeof(user_input);
 	}
 	/* 파일 디스크립터가 0이 아닐 경우 파일의 데이터를 크기만큼 저장 후 읽은 바이트 수를 리턴 */
+	/* NOTE: [4.3] 동기화는 파일 시스템이 inode, 디렉터리 단위로 처리하므로 전역 락 없이 읽음 (file_io() 참고) */
 	if (fd >= 2 && file)
 	{
-		int bytes = file_read(file, buffer, size);
-		lock_release(&filesys_lock);
-		return bytes;
+		check_buffer(buffer, size, true);
+		return file_io(file, buffer, size, false);
 	}
-	lock_release(&filesys_lock);
 	return -1;
 }
 
@@ -276,51 +316,43 @@ int write(int fd, const void *buffer, unsigned size)
 {
 	check_address(buffer);
 
-	/* 파일에 동시 접근이 일어날 수 있으므로 Lock 사용 */
-	lock_acquire(&filesys_lock);
 	/* 파일 디스크립터를 이용하여 파일 객체 검색 */
 	struct file *file = process_get_file(fd);
 	/* 파일 디스크립터가 1일 경우 버퍼에 저장된 값을 화면에 출력 후 버퍼의 크기 리턴 (putbuf() 이용) */
 	if (fd == 1)
 	{
 		putbuf(buffer, size);
-		lock_release(&filesys_lock);
 		return sizeof(buffer);
 	}
 	/* 파일 디스크립터가 1이 아닐 경우 버퍼에 저장된 데이터를 크기만큼 파일에 기록 후 기록한 바이트 수를 리턴 */
+	/* NOTE: [4.3] read()와 같이 file_io()로 기록 */
 	if (fd >= 2 && file)
 	{
-		int bytes = file_write(file, buffer, size);
-		lock_release(&filesys_lock);
-		return bytes;
+		check_buffer(buffer, size, false);
+		return file_io(file, (void *)buffer, size, true);
 	}
-	lock_release(&filesys_lock);
 	return -1;
 }
 
 /* NOTE: [2.4] seek() 시스템 콜 구현 */
 void seek(int fd, unsigned position)
 {
-	lock_acquire(&filesys_lock);
 	/* 파일 디스크립터를 이용하여 파일 객체 검색 */
 	struct file *file = process_get_file(fd);
 	/* 해당 열린 파일의 위치(offset)를 position만큼 이동 */
 	if (file)
 		file_seek(file, position);
-	lock_release(&filesys_lock);
 }
 
 /* NOTE: [2.4] tell() 시스템 콜 구현 */
 unsigned tell(int fd)
 {
-	lock_acquire(&filesys_lock);
 	/* 파일 디스크립터를 이용하여 파일 객체 검색 */
 	struct file *file = process_get_file(fd);
 	unsigned position = -1;
 	/* 해당 열린 파일의 위치를 반환 */
 	if (file)
 		position = file_tell(file);
-	lock_release(&filesys_lock);
 	return position;
 }
 
@@ -331,6 +363,91 @@ void close(int fd)
 	process_close_file(fd);
 }
 
+#ifdef VM
+/* NOTE: [3.4] mmap() 시스템 콜 구현 */
+void *mmap(void *addr, size_t length, int writable, int fd, off_t offset)
+{
+	/* 주소와 오프셋은 페이지 정렬, 길이는 0보다 커야 하고 매핑 전체가 유저 영역이어야 함 */
+	if (addr == NULL || pg_ofs(addr) != 0 || offset % PGSIZE != 0)
+		return NULL;
+	if ((int64_t)length <= 0 || (uint8_t *)addr + length < (uint8_t *)addr)
+		return NULL;
+	if (is_kernel_vaddr(addr) || is_kernel_vaddr((uint8_t *)addr + length))
+		return NULL;
+
+	/* NOTE: [3.4] 익명 매핑은 fd 없이 0으로 채워진 페이지, MAP_SHARED면 fork한 자식과 공유 */
+	bool shared = (writable & MAP_SHARED) != 0;
+	bool anonymous = (writable & MAP_ANONYMOUS) != 0;
+	writable &= ~(MAP_SHARED | MAP_ANONYMOUS);
+	if (anonymous)
+		return do_mmap_anon(addr, length, writable, shared);
+	/* 파일 매핑의 변경은 이미 파일에 반영되므로 공유 파일 매핑은 지원하지 않음 */
+	if (shared)
+		return NULL;
+
+	/* 콘솔 입출력(0, 1)은 매핑할 수 없음 */
+	struct file *file = process_get_file(fd);
+	void *ret = NULL;
+	if (file != NULL && file_length(file) > 0)
+		ret = do_mmap(addr, length, writable, file, offset);
+	return ret;
+}
+
+/* NOTE: [3.4] munmap() 시스템 콜 구현 */
+void munmap(void *addr)
+{
+	do_munmap(addr);
+}
+
+/* NOTE: [3.4] msync() 시스템 콜 구현: addr이 속한 매핑의 dirty 페이지를 파일에 즉시 기록 */
+int msync(void *addr)
+{
+	return do_msync(addr) ? 0 : -1;
+}
+
+/* NOTE: [3.4] madvise() 시스템 콜 구현: 접근 패턴 힌트, 선반입(WILLNEED), 즉시 해제(DONTNEED) */
+int madvise(void *addr, size_t length, int advice)
+{
+	if (addr == NULL || pg_ofs(addr) != 0 || (int64_t)length <= 0)
+		return -1;
+	if (is_kernel_vaddr(addr) || (uint8_t *)addr + length < (uint8_t *)addr || is_kernel_vaddr((uint8_t *)addr + length))
+		return -1;
+	if (advice < MADV_NORMAL || advice > MADV_DONTNEED)
+		return -1;
+	return vm_madvise(addr, length, advice) ? 0 : -1;
+}
+
+/* NOTE: [3.4] memstat() 시스템 콜 구현: 현재 프로세스의 프레임, 스왑, 페이지 테이블, FDT 사용량을 페이지 단위로 보고 */
+int memstat(struct memstat *stat)
+{
+	struct thread *curr = thread_current();
+	struct memstat st;
+
+	check_address(stat);
+	check_address((uint8_t *)stat + sizeof *stat - 1);
+	st.rss = curr->rss_cnt;
+	st.swap = curr->swap_cnt;
+	st.page_tables = pml4_table_cnt(curr->pml4);
+	/* FDT는 FDT_MAX개의 포인터를 담는 페이지 (thread_create()에서 할당) */
+	st.fdt = curr->fdt != NULL ? DIV_ROUND_UP(FDT_MAX * sizeof *curr->fdt, PGSIZE) : 0;
+	st.open_files = 0;
+	for (int idx = 2; idx < FDT_MAX; idx++)
+		if (curr->fdt[idx] != NULL)
+			st.open_files++;
+	st.rss_limit = curr->rss_limit;
+
+	memcpy(stat, &st, sizeof st);
+	return 0;
+}
+
+/* NOTE: [3.4] memlimit() 시스템 콜 구현: 프레임 수 상한 설정 (0이면 해제), 넘으면 자기 페이지부터 회수 */
+int memlimit(size_t rss_pages)
+{
+	thread_current()->rss_limit = rss_pages;
+	return 0;
+}
+#endif
+
 /* ---------- UTIL ---------- */
 /* NOTE: [2.2] 추가 함수 - 주소 값이 유저 영역에서 사용하는 주소 값인지 확인하는 함수 */
 void check_address(void *addr)
@@ -338,3 +455,84 @@ void check_address(void *addr)
 	if (addr == NULL || is_kernel_vaddr(addr))
 		exit(-1);
 }
+
+/* NOTE: [4.3] 추가 함수 - 유저 버퍼 BUFFER의 SIZE 바이트가 모두 유저 영역이고 접근 가능한지 페이지마다 미리 접근하여 확인.
+   WRITABLE이면 같은 값을 다시 써서 쓰기도 확인. 잘못된 주소면 자원을 잡기 전인 여기서 page fault로 종료 */
+void check_buffer(const void *buffer, unsigned size, bool writable)
+{
+	const uint8_t *start = buffer;
+	const uint8_t *end = start + size;
+
+	if (size == 0)
+		return;
+	if (end < start || is_kernel_vaddr((void *)(end - 1)))
+		exit(-1);
+	for (const uint8_t *p = start; p < end; p = pg_round_down(p) + PGSIZE)
+	{
+		volatile uint8_t *byte = (volatile uint8_t *)p;
+		uint8_t value = *byte;
+
+		if (writable)
+			*byte = value;
+	}
+}
+
+/* NOTE: [4.3] 추가 함수 - read/write의 파일 입출력. 파일 시스템의 락을 잡은 채 유저 메모리에서 page fault가 나지 않도록
+   커널 페이지를 거쳐 PGSIZE씩 옮김. 한 페이지 이하의 read/write는 file_read/file_write 한 번으로 처리되어 원자적이지만,
+   그보다 크면 페이지 단위로 나뉘므로 같은 파일을 동시에 쓰는 다른 프로세스의 기록과 섞일 수 있음.
+   유저 버퍼는 check_buffer()로 미리 확인하므로 복사 중의 page fault로 커널 페이지가 새지 않음 */
+static int file_io(struct file *file, void *buffer, unsigned size, bool write)
+{
+	uint8_t small[IO_CHUNK_MIN];
+	uint8_t *chunk = palloc_get_page(0);
+	unsigned chunk_size = PGSIZE;
+	unsigned bytes = 0;
+
+	/* 커널 페이지가 부족하면 실패하지 않고 작은 스택 버퍼로 처리 */
+	if (chunk == NULL)
+	{
+		chunk = small;
+		chunk_size = sizeof small;
+	}
+	while (bytes < size)
+	{
+		unsigned want = size - bytes < chunk_size ? size - bytes : chunk_size;
+		int done;
+
+		if (write)
+		{
+			memcpy(chunk, (uint8_t *)buffer + bytes, want);
+			done = file_write(file, chunk, want);
+		}
+		else
+		{
+			done = file_read(file, chunk, want);
+			if (done > 0)
+				memcpy((uint8_t *)buffer + bytes, chunk, done);
+		}
+		if (done <= 0)
+			break;
+		bytes += done;
+		if ((unsigned)done < want)
+			break;
+	}
+	if (chunk != small)
+		palloc_free_page(chunk);
+	return bytes;
+}
+
+/* NOTE: [4.3] 추가 함수 - 유저 문자열 USTR을 커널 버퍼 DST(SIZE 바이트)로 한 바이트씩 복사.
+   파일 시스템이 디렉터리 락을 잡은 채 유저 메모리를 읽다가 page fault로 종료되지 않도록 미리 복사하며,
+   바이트마다 주소를 확인하고 SIZE 안에서 끝나지 않는 문자열은 복사하지 않고 false 반환.
+   파일 이름은 DST를 NAME_MAX + 2 바이트로 잡아, NAME_MAX보다 한 글자 긴 이름까지 넘겨 파일 시스템이 거절하게 함 */
+bool copy_in_string(char *dst, const char *ustr, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		check_address((void *)(ustr + i));
+		dst[i] = ustr[i];
+		if (dst[i] == '\0')
+			return true;
+	}
+	return false;
+}
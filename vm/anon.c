@@ -1,7 +1,46 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <bitmap.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
 #include "vm/vm.h"
+#include "vm/lz.h"
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Sectors per swap slot; a slot holds one page. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Most slots read ahead after a swap-in. */
+#define SWAP_READAHEAD 4
+
+/* Most compressed pages written to disk in one batch. */
+#define ZSWAP_WRITEBACK 8
+
+/* Bytes of compressed pages kept in memory before the oldest go to the
+ * swap disk. */
+#define ZSWAP_POOL_BYTES (1024 * 1024)
+
+/* Bytes the pool never exceeds.  Once the swap disk is full the pool
+ * cannot shrink, so stores fail past this and the pages stay resident. */
+#define ZSWAP_POOL_MAX (ZSWAP_POOL_BYTES + ZSWAP_POOL_BYTES / 4)
+
+/* A compressed page in the in-memory pool. */
+struct zswap_entry {
+	struct page *page;          /* Page it holds. */
+	struct list_elem elem;      /* Element in zswap_lru. */
+	size_t len;                 /* Bytes in DATA. */
+	uint8_t data[];             /* Compressed contents. */
+};
+
+/* Longest compressed page worth keeping.  malloc() rounds any block over
+ * 1 kB up to a whole page, so a page that compresses worse than about
+ * 4:1 goes straight to disk. */
+#define ZSWAP_MAX_LEN (1024 - sizeof (struct zswap_entry))
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,36 +56,448 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* Swap slots.  SWAP_MAP records the page in each used slot, so that
+ * read-ahead can tell which neighbouring slots belong to the same
+ * process. */
+static struct bitmap *swap_slots;   /* Used slots. */
+static struct page **swap_map;      /* Page held in each slot. */
+static size_t swap_hint;            /* Where the next slot search starts. */
+
+/* Compressed pool, oldest entry first.  Evicted pages are compressed
+ * into it and reach the disk only when it outgrows ZSWAP_POOL_BYTES. */
+static struct list zswap_lru;
+static size_t zswap_bytes;          /* Bytes of compressed data held. */
+static uint8_t zswap_buf[PGSIZE];   /* Codec output. */
+static uint16_t lz_table[LZ_HASH_SIZE]; /* Codec scratch space. */
+static bool zswap_shrinking;        /* zswap_shrink() running? */
+static uint8_t shrink_buf[PGSIZE];  /* Its bounce buffer. */
+
+/* Protects everything above and the eviction state of anonymous
+ * pages. */
+static struct lock swap_lock;
+
+/* Signaled, with swap_lock, when pages finish moving from the pool to
+ * the swap disk. */
+static struct condition zswap_written;
+
+/* Swap statistics. */
+static long long swap_out_cnt;      /* Pages written to swap. */
+static long long swap_cluster_cnt;  /* Batches they were written in. */
+static long long swap_in_cnt;       /* Pages read back from disk on a fault. */
+static long long readahead_cnt;     /* Pages read back ahead of a fault. */
+static long long zero_cnt;          /* Zero pages evicted as a flag. */
+static long long zswap_store_cnt;   /* Pages evicted into the pool. */
+static long long zswap_store_bytes; /* Their compressed size. */
+static long long zswap_hit_cnt;     /* Faults served from memory. */
+static long long writeback_cnt;     /* Pool pages later written to disk. */
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	size_t slot_cnt;
+
+	lock_init (&swap_lock);
+	cond_init (&zswap_written);
+	list_init (&zswap_lru);
+	swap_disk = disk_get (1, 1);
+	if (swap_disk == NULL)
+		return;
+
+	slot_cnt = disk_size (swap_disk) / SECTORS_PER_SLOT;
+	swap_slots = bitmap_create (slot_cnt);
+	swap_map = calloc (slot_cnt, sizeof *swap_map);
+	if (swap_slots == NULL || swap_map == NULL)
+		PANIC ("swap table creation failed--swap disk is too large");
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED, void *kva) {
 	/* Set up the handler */
+	anon_adopt (page);
+
+	/* A recycled frame still holds its previous owner's data. */
+	memset (kva, 0, PGSIZE);
+	return true;
+}
+
+/* Turns PAGE into an anonymous page, leaving the contents of its frame
+ * alone.  Used for segment pages that the process writes to. */
+void
+anon_adopt (struct page *page) {
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->slot = BITMAP_ERROR;
+	anon_page->zswap = NULL;
+	anon_page->zero = false;
+	anon_page->readahead = false;
+	anon_page->writing = false;
+}
+
+/* Returns true if PAGE was evicted while all zero. */
+bool
+anon_is_zero (struct page *page) {
+	bool zero;
+
+	lock_acquire (&swap_lock);
+	zero = page->anon.zero;
+	lock_release (&swap_lock);
+	return zero;
+}
+
+/* Forgets that PAGE was evicted while all zero, once the caller has
+ * provided the zeros itself. */
+void
+anon_clear_zero (struct page *page) {
+	lock_acquire (&swap_lock);
+	page->anon.zero = false;
+	lock_release (&swap_lock);
+}
+
+/* Reserves CNT contiguous swap slots.  The search is next-fit, so
+ * consecutive evictions land next to each other on disk.  Returns the
+ * first slot, or BITMAP_ERROR if no run of CNT slots is free.  Must be
+ * called with swap_lock held. */
+static size_t
+slot_alloc (size_t cnt) {
+	size_t slot = bitmap_scan_and_flip (swap_slots, swap_hint, cnt, false);
+
+	if (slot == BITMAP_ERROR && swap_hint != 0)
+		slot = bitmap_scan_and_flip (swap_slots, 0, cnt, false);
+	if (slot != BITMAP_ERROR)
+		swap_hint = slot + cnt;
+	return slot;
+}
+
+/* Releases SLOT. */
+static void
+slot_free (size_t slot) {
+	lock_acquire (&swap_lock);
+	swap_map[slot] = NULL;
+	bitmap_reset (swap_slots, slot);
+	lock_release (&swap_lock);
+}
+
+/* Reserves up to CNT contiguous swap slots, fewer if no run of CNT is
+ * free.  Stores the first slot in *SLOT and returns how many were
+ * reserved, possibly 0.  Must be called with swap_lock held. */
+static size_t
+slot_alloc_run (size_t cnt, size_t *slot) {
+	if (swap_slots == NULL)
+		return 0;
+	for (; cnt > 0; cnt /= 2) {
+		*slot = slot_alloc (cnt);
+		if (*slot != BITMAP_ERROR)
+			break;
+	}
+	return cnt;
+}
+
+/* Writes the page at KVA to SLOT. */
+static void
+slot_write (size_t slot, const void *kva) {
+	size_t i;
+
+	for (i = 0; i < SECTORS_PER_SLOT; i++)
+		disk_write (swap_disk, slot * SECTORS_PER_SLOT + i,
+				(const uint8_t *) kva + i * DISK_SECTOR_SIZE);
+}
+
+/* Reads SLOT into the page at KVA. */
+static void
+slot_read (size_t slot, void *kva) {
+	size_t i;
+
+	for (i = 0; i < SECTORS_PER_SLOT; i++)
+		disk_read (swap_disk, slot * SECTORS_PER_SLOT + i,
+				(uint8_t *) kva + i * DISK_SECTOR_SIZE);
+}
+
+/* Adds DELTA to the count of swapped pages of PAGE's process.  Pages
+ * kept only as the zero flag take no swap and are not counted.  Must be
+ * called with swap_lock held. */
+static void
+swap_account (struct page *page, int delta) {
+	if (page->owner != NULL)
+		page->owner->swap_cnt += delta;
+}
+
+/* Returns true if every byte of the page at KVA is zero. */
+static bool
+page_is_zero (const void *kva) {
+	const uint64_t *p = kva;
+	size_t i;
+
+	for (i = 0; i < PGSIZE / sizeof *p; i++)
+		if (p[i] != 0)
+			return false;
+	return true;
+}
+
+/* Waits until PAGE is not moving from the pool to the swap disk.  Must
+ * be called with swap_lock held. */
+static void
+zswap_wait (struct page *page) {
+	while (page->anon.writing)
+		cond_wait (&zswap_written, &swap_lock);
+}
+
+/* Writes the oldest pages of the compressed pool to the swap disk, in
+ * batches of contiguous slots, until the pool fits in ZSWAP_POOL_BYTES
+ * again or the disk is full.  The pages of a batch get their slots at
+ * once and are marked WRITING, and swap_lock is released for the writes;
+ * zswap_wait() holds off anyone who would read or free them meanwhile.
+ * One thread shrinks the pool at a time.  Must be called with swap_lock
+ * held. */
+static void
+zswap_shrink (void) {
+	if (zswap_shrinking)
+		return;
+	zswap_shrinking = true;
+	while (zswap_bytes > ZSWAP_POOL_BYTES) {
+		struct zswap_entry *batch[ZSWAP_WRITEBACK];
+		size_t slot, cnt, i;
+
+		cnt = list_size (&zswap_lru);
+		cnt = slot_alloc_run (cnt < ZSWAP_WRITEBACK ? cnt : ZSWAP_WRITEBACK,
+				&slot);
+		if (cnt == 0)
+			break;
+
+		for (i = 0; i < cnt; i++) {
+			struct zswap_entry *e = list_entry (list_pop_front (&zswap_lru),
+					struct zswap_entry, elem);
+			struct page *page = e->page;
+
+			swap_map[slot + i] = page;
+			page->anon.slot = slot + i;
+			page->anon.zswap = NULL;
+			page->anon.writing = true;
+			zswap_bytes -= e->len;
+			batch[i] = e;
+		}
+		lock_release (&swap_lock);
+
+		for (i = 0; i < cnt; i++) {
+			struct zswap_entry *e = batch[i];
+
+			if (!lz_decompress (e->data, e->len, shrink_buf, PGSIZE))
+				PANIC ("corrupt compressed page");
+			slot_write (slot + i, shrink_buf);
+			free (e);
+		}
+
+		lock_acquire (&swap_lock);
+		for (i = 0; i < cnt; i++)
+			swap_map[slot + i]->anon.writing = false;
+		cond_broadcast (&zswap_written, &swap_lock);
+		writeback_cnt += cnt;
+		swap_out_cnt += cnt;
+		swap_cluster_cnt++;
+	}
+	zswap_shrinking = false;
+}
+
+/* Compresses PAGE into the pool.  Returns false if it does not compress
+ * well enough, the pool is at ZSWAP_POOL_MAX or memory runs out.  Must
+ * be called with swap_lock held. */
+static bool
+zswap_store (struct page *page) {
+	size_t len = lz_compress (page->frame->kva, PGSIZE, zswap_buf,
+			ZSWAP_MAX_LEN, lz_table);
+	struct zswap_entry *e;
+
+	if (len == 0 || zswap_bytes + len > ZSWAP_POOL_MAX)
+		return false;
+	e = malloc (sizeof *e + len);
+	if (e == NULL)
+		return false;
+	e->page = page;
+	e->len = len;
+	memcpy (e->data, zswap_buf, len);
+	list_push_back (&zswap_lru, &e->elem);
+	zswap_bytes += len;
+	page->anon.zswap = e;
+	swap_account (page, 1);
+
+	zswap_store_cnt++;
+	zswap_store_bytes += len;
+	return true;
+}
+
+/* Evicts the resident anonymous PAGES, CNT of them.  Zero pages are
+ * kept as a flag and compressible pages go to the compressed pool.  The
+ * rest go to contiguous swap slots, so they are written as one run of
+ * sequential sectors.  If no run of slots is large enough, fewer are
+ * written.  On return the evicted pages come first in PAGES; returns how
+ * many there are.  Their frames are left to the caller. */
+size_t
+anon_swap_out_cluster (struct page *pages[], size_t cnt) {
+	size_t done = 0, disk_cnt, slot, i;
+
+	lock_acquire (&swap_lock);
+	for (i = 0; i < cnt; i++) {
+		struct page *page = pages[i];
+
+		if (page_is_zero (page->frame->kva)) {
+			page->anon.zero = true;
+			zero_cnt++;
+		} else if (!zswap_store (page))
+			continue;
+		pages[i] = pages[done];
+		pages[done++] = page;
+	}
+	zswap_shrink ();
+
+	disk_cnt = slot_alloc_run (cnt - done, &slot);
+	for (i = 0; i < disk_cnt; i++) {
+		swap_map[slot + i] = pages[done + i];
+		swap_account (pages[done + i], 1);
+	}
+	lock_release (&swap_lock);
+	if (disk_cnt == 0)
+		return done;
+
+	for (i = 0; i < disk_cnt; i++) {
+		struct page *page = pages[done + i];
+
+		slot_write (slot + i, page->frame->kva);
+		page->anon.slot = slot + i;
+	}
+	swap_out_cnt += disk_cnt;
+	swap_cluster_cnt++;
+	return done + disk_cnt;
+}
+
+/* Brings in the pages of PAGE's process held in the slots after SLOT,
+ * while free frames last.  A process that faults in swapped memory
+ * sequentially then finds the following pages already resident. */
+static void
+swap_readahead (struct page *page, size_t slot) {
+	size_t end = slot + 1 + SWAP_READAHEAD;
+	size_t s;
+
+	/* The master pages of shared memory belong to no process. */
+	if (page->owner == NULL)
+		return;
+	if (end > bitmap_size (swap_slots))
+		end = bitmap_size (swap_slots);
+	for (s = slot + 1; s < end; s++) {
+		struct page *next;
+		bool success;
+
+		lock_acquire (&swap_lock);
+		next = swap_map[s];
+		lock_release (&swap_lock);
+		if (next == NULL || next->owner != page->owner)
+			break;
+
+		next->anon.readahead = true;
+		success = vm_prefetch_page (next);
+		next->anon.readahead = false;
+		if (!success)
+			break;
+		readahead_cnt++;
+	}
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	struct zswap_entry *e;
+	size_t slot;
+
+	lock_acquire (&swap_lock);
+	zswap_wait (page);
+	if (anon_page->zero) {
+		anon_page->zero = false;
+		zswap_hit_cnt++;
+		lock_release (&swap_lock);
+		memset (kva, 0, PGSIZE);
+		return true;
+	}
+	e = anon_page->zswap;
+	if (e != NULL) {
+		bool success;
+
+		list_remove (&e->elem);
+		zswap_bytes -= e->len;
+		anon_page->zswap = NULL;
+		swap_account (page, -1);
+		zswap_hit_cnt++;
+		lock_release (&swap_lock);
+
+		success = lz_decompress (e->data, e->len, kva, PGSIZE);
+		free (e);
+		return success;
+	}
+	slot = anon_page->slot;
+	if (slot != BITMAP_ERROR)
+		swap_account (page, -1);
+	lock_release (&swap_lock);
+
+	if (slot == BITMAP_ERROR)
+		return false;
+	slot_read (slot, kva);
+	slot_free (slot);
+	anon_page->slot = BITMAP_ERROR;
+
+	if (!anon_page->readahead) {
+		swap_in_cnt++;
+		swap_readahead (page, slot);
+	}
+	return true;
 }
 
 /* Swap out the page by writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	return anon_swap_out_cluster (&page, 1) == 1;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	/* Free the frame first.  That waits for an eviction in progress,
+	 * which may still give PAGE a slot or a zswap entry. */
+	vm_free_frame (page);
+
+	lock_acquire (&swap_lock);
+	zswap_wait (page);
+	if (anon_page->zswap != NULL) {
+		list_remove (&anon_page->zswap->elem);
+		zswap_bytes -= anon_page->zswap->len;
+		free (anon_page->zswap);
+		anon_page->zswap = NULL;
+		swap_account (page, -1);
+	}
+	if (anon_page->slot != BITMAP_ERROR) {
+		swap_account (page, -1);
+		swap_map[anon_page->slot] = NULL;
+		bitmap_reset (swap_slots, anon_page->slot);
+		anon_page->slot = BITMAP_ERROR;
+	}
+	lock_release (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void) {
+	long long mem_cnt = zero_cnt + zswap_store_cnt;
+
+	printf ("Swap: %lld pages out in %lld batches, %lld pages in, "
+			"%lld read ahead\n", swap_out_cnt, swap_cluster_cnt, swap_in_cnt,
+			readahead_cnt);
+	printf ("Zswap: %lld zero pages, %lld compressed to %lld%%, "
+			"%lld%% hit rate, %lld disk writes avoided\n",
+			zero_cnt, zswap_store_cnt,
+			zswap_store_cnt > 0
+				? zswap_store_bytes * 100 / (zswap_store_cnt * PGSIZE) : 0,
+			zswap_hit_cnt + swap_in_cnt > 0
+				? zswap_hit_cnt * 100 / (zswap_hit_cnt + swap_in_cnt) : 0,
+			mem_cnt - writeback_cnt);
 }
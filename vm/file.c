@@ -1,6 +1,58 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <stdio.h>
+#include <string.h>
 #include "vm/vm.h"
+#include "devices/timer.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Mapped pages the flusher writes back per pass over the frame table. */
+#define FLUSH_BATCH 16
+
+/* Ticks between writeback passes, and between checks for a request. */
+#define FLUSH_INTERVAL TIMER_FREQ
+#define FLUSH_POLL (TIMER_FREQ / 10)
+
+/* Dirty mapped pages a process may hold before its writes wait for the
+ * flusher. */
+#define DIRTY_LIMIT 64
+
+/* A dirty page copied out by the flusher, waiting to be written. */
+struct flush_rec {
+	struct page *page;          /* Page copied, marked FLUSHING. */
+	struct inode *inode;        /* Reopened, closed after the write. */
+	off_t ofs;                  /* Position in INODE. */
+	size_t bytes;               /* Bytes to write. */
+	uint8_t *data;              /* Copy of the page's contents. */
+};
+
+/* Pages collected by one pass of flush_collect(). */
+struct flush_batch {
+	struct flush_rec recs[FLUSH_BATCH];
+	uint8_t *slots;             /* FLUSH_BATCH pages of copies. */
+	size_t cnt;
+};
+
+static bool flusher_started;       /* Set under FLUSH_LOCK. */
+static volatile bool flush_wanted;  /* A writer asked for a pass. */
+static unsigned flush_gen;          /* Passes completed so far. */
+static struct lock flush_lock;      /* Protects FLUSH_GEN and clearing
+                                       pages' FLUSHING flags. */
+static struct condition flush_done; /* Signaled after every pass. */
+static struct condition flush_written; /* Signaled after every batch. */
+
+/* Writeback statistics. */
+static long long flush_page_cnt;    /* Pages written by the flusher. */
+static long long flush_run_cnt;     /* inode_write_at() calls they took. */
+static long long throttle_cnt;      /* Writers that waited for a pass. */
+static long long msync_page_cnt;    /* Pages written by msync(). */
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
@@ -17,42 +69,442 @@ static const struct page_operations file_ops = {
 /* The initializer of file vm */
 void
 vm_file_init (void) {
+	lock_init (&flush_lock);
+	cond_init (&flush_done);
+	cond_init (&flush_written);
 }
 
 /* Initialize the file backed page */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type,
+		void *kva UNUSED) {
+	/* Fetch first, file_page shares storage with uninit_page. */
+	struct lazy_load_info *info = page->uninit.aux;
+
 	/* Set up the handler */
 	page->operations = &file_ops;
 
 	struct file_page *file_page = &page->file;
+	file_page->file = info->file;
+	file_page->ofs = info->ofs;
+	file_page->read_bytes = info->read_bytes;
+	file_page->segment = (type & VM_SEGMENT) != 0;
+	file_page->dirty = false;
+	file_page->flushing = false;
+	free (info);
+	return true;
+}
+
+/* If PAGE is an executable segment page, initialized or not, stores the
+ * file position of its contents in *INODE, *OFS and *READ_BYTES and
+ * returns true.  Returns false for any other page. */
+bool
+file_segment_pos (struct page *page, struct inode **inode, off_t *ofs,
+		size_t *read_bytes) {
+	if (page->operations == &file_ops) {
+		if (!page->file.segment)
+			return false;
+		*inode = file_get_inode (page->file.file);
+		*ofs = page->file.ofs;
+		*read_bytes = page->file.read_bytes;
+		return true;
+	}
+	if (VM_TYPE (page->operations->type) == VM_UNINIT
+			&& VM_TYPE (page->uninit.type) == VM_FILE
+			&& (page->uninit.type & VM_SEGMENT) != 0) {
+		struct lazy_load_info *info = page->uninit.aux;
+
+		*inode = file_get_inode (info->file);
+		*ofs = info->ofs;
+		*read_bytes = info->read_bytes;
+		return true;
+	}
+	return false;
+}
+
+/* Reads PAGE's contents from its file into KVA. */
+static bool
+file_read_page (struct page *page, void *kva) {
+	struct file_page *file_page = &page->file;
+	off_t bytes_read;
+
+	bytes_read = file_read_at (file_page->file, kva, file_page->read_bytes,
+			file_page->ofs);
+
+	memset ((uint8_t *) kva + file_page->read_bytes, 0,
+			PGSIZE - file_page->read_bytes);
+	return bytes_read == (off_t) file_page->read_bytes;
+}
+
+/* Adds DELTA to the count of dirty mapped pages of PAGE's owner.  The
+ * flusher and the evictor change it with frame_lock held, but msync()
+ * and munmap() do not, so the update is made atomic by turning
+ * interrupts off. */
+static void
+dirty_account (struct page *page, int delta) {
+	enum intr_level old_level = intr_disable ();
+
+	page->owner->mmap_dirty_cnt += delta;
+	intr_set_level (old_level);
+}
+
+/* Marks PAGE, a resident mapped page, dirty and counts it against its
+ * owner.  Must be called with frame_lock held. */
+void
+file_set_dirty (struct page *page) {
+	if (page->file.segment || page->file.dirty)
+		return;
+	page->file.dirty = true;
+	dirty_account (page, 1);
+}
+
+/* Marks PAGE clean again.  Must be called with frame_lock held or PAGE
+ * pinned, which keeps the flusher and the evictor away from it. */
+static void
+file_clear_dirty (struct page *page) {
+	page->file.dirty = false;
+	dirty_account (page, -1);
+}
+
+/* Maps PAGE read-only, so that its next write faults and marks it dirty
+ * again.  Clearing first drops the dirty bit and the stale TLB entry. */
+static void
+file_write_protect (struct page *page) {
+	uint64_t *pml4 = page->owner->pml4;
+
+	pml4_clear_page (pml4, page->va);
+	pml4_set_page (pml4, page->va, page->frame->kva, false);
+}
+
+/* Waits until the flusher has written its copy of PAGE, if it holds
+ * one, so that the older copy cannot land on top of a newer write.
+ * The caller keeps the flusher from taking another copy: PAGE is pinned,
+ * or frame_lock is held. */
+static void
+flush_wait (struct page *page) {
+	lock_acquire (&flush_lock);
+	while (page->file.flushing)
+		cond_wait (&flush_written, &flush_lock);
+	lock_release (&flush_lock);
+}
+
+/* Writes PAGE back to its file if the user modified it.  Returns true if
+ * it did.  Either way, the flusher's copy of PAGE, if any, is on disk
+ * first. */
+static bool
+file_write_back (struct page *page) {
+	struct file_page *file_page = &page->file;
+
+	flush_wait (page);
+
+	/* Mapped pages stay read-only until written, so the flag set by the
+	 * write fault is exact.  Segment pages never get it. */
+	if (!file_page->dirty)
+		return false;
+
+	file_write_at (file_page->file, page->frame->kva, file_page->read_bytes,
+			file_page->ofs);
+	file_clear_dirty (page);
+	return true;
+}
+
+/* Loads a mapped or segment page on its first fault. */
+bool
+file_lazy_load (struct page *page, void *aux UNUSED) {
+	return file_read_page (page, page->frame->kva);
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	return file_read_page (page, kva);
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file.  A clean page is
+ * simply dropped; the file still holds its contents. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	file_write_back (page);
+	return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	/* Pinned, so the evictor cannot write it back concurrently. */
+	if (vm_pin_page (page)) {
+		file_write_back (page);
+		vm_free_frame (page);
+	}
+}
+
+/* Copies out the dirty mapped pages of FRAME into the batch in AUX and
+ * write-protects them.  Returns false once the batch is full.  Called
+ * by vm_for_each_frame() with frame_lock held. */
+static bool
+flush_collect (struct frame *frame, void *aux) {
+	struct flush_batch *batch = aux;
+	struct list_elem *e;
+
+	/* Pinned frames are being loaded, written or torn down. */
+	if (frame->pin_cnt > 0)
+		return true;
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		struct flush_rec *rec;
+
+		if (page->operations != &file_ops || !page->file.dirty)
+			continue;
+		if (batch->cnt == FLUSH_BATCH)
+			return false;
+
+		/* Protect before copying, so that a write after the copy
+		 * faults and dirties the page again. */
+		file_write_protect (page);
+		file_clear_dirty (page);
+		page->file.flushing = true;
+		rec = &batch->recs[batch->cnt];
+		rec->page = page;
+		rec->inode = inode_reopen (file_get_inode (page->file.file));
+		rec->ofs = page->file.ofs;
+		rec->bytes = page->file.read_bytes;
+		rec->data = batch->slots + batch->cnt * PGSIZE;
+		memcpy (rec->data, frame->kva, PGSIZE);
+		batch->cnt++;
+	}
+	return true;
+}
+
+/* Returns true if record A goes before record B on disk. */
+static bool
+flush_rec_less (const struct flush_rec *a, const struct flush_rec *b) {
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	return a->ofs < b->ofs;
+}
+
+/* Writes the CNT records of RECS, sorted by file position, merging
+ * records of whole pages that follow each other in the same file into a
+ * single write through RUN, a buffer of FLUSH_BATCH pages. */
+static void
+flush_write (struct flush_rec *recs, size_t cnt, uint8_t *run) {
+	size_t i, j;
+
+	for (i = 0; i < cnt; i = j) {
+		size_t bytes = recs[i].bytes;
+
+		memcpy (run, recs[i].data, recs[i].bytes);
+		for (j = i + 1; j < cnt && recs[j].inode == recs[i].inode
+				&& recs[j].ofs == recs[j - 1].ofs + PGSIZE
+				&& recs[j - 1].bytes == PGSIZE; j++) {
+			memcpy (run + bytes, recs[j].data, recs[j].bytes);
+			bytes += recs[j].bytes;
+		}
+		if (bytes > 0) {
+			inode_write_at (recs[i].inode, run, bytes, recs[i].ofs);
+			flush_run_cnt++;
+		}
+	}
+
+	lock_acquire (&flush_lock);
+	for (i = 0; i < cnt; i++)
+		recs[i].page->file.flushing = false;
+	cond_broadcast (&flush_written, &flush_lock);
+	lock_release (&flush_lock);
+
+	for (i = 0; i < cnt; i++)
+		inode_close (recs[i].inode);
+	flush_page_cnt += cnt;
+}
+
+/* Writes every dirty mapped page back, a batch at a time.  SLOTS and
+ * RUN are buffers of FLUSH_BATCH pages each. */
+static void
+flush_all (uint8_t *slots, uint8_t *run) {
+	struct flush_batch batch;
+	size_t i, j;
+
+	do {
+		batch.slots = slots;
+		batch.cnt = 0;
+
+		/* A page's file stays open while the page is in a frame, so
+		 * the records can reopen the inodes under frame_lock. */
+		vm_for_each_frame (flush_collect, &batch);
+
+		/* Insertion sort; batches are small. */
+		for (i = 1; i < batch.cnt; i++) {
+			struct flush_rec rec = batch.recs[i];
+
+			for (j = i; j > 0 && flush_rec_less (&rec, &batch.recs[j - 1]);
+					j--)
+				batch.recs[j] = batch.recs[j - 1];
+			batch.recs[j] = rec;
+		}
+		flush_write (batch.recs, batch.cnt, run);
+	} while (batch.cnt == FLUSH_BATCH);
+}
+
+/* The flusher thread.  Writes dirty mapped pages back every
+ * FLUSH_INTERVAL ticks, or sooner when a throttled writer asks. */
+static void
+flusher (void *aux UNUSED) {
+	uint8_t *slots = palloc_get_multiple (PAL_ASSERT, FLUSH_BATCH);
+	uint8_t *run = palloc_get_multiple (PAL_ASSERT, FLUSH_BATCH);
+
+	for (;;) {
+		int i;
+
+		for (i = 0; i < FLUSH_INTERVAL / FLUSH_POLL && !flush_wanted; i++)
+			timer_sleep (FLUSH_POLL);
+		flush_wanted = false;
+		flush_all (slots, run);
+
+		lock_acquire (&flush_lock);
+		flush_gen++;
+		cond_broadcast (&flush_done, &flush_lock);
+		lock_release (&flush_lock);
+	}
+}
+
+/* Makes the current process wait for the flusher while it holds more
+ * than DIRTY_LIMIT dirty mapped pages.  Two completed passes are enough:
+ * the second started after the wait did. */
+void
+file_throttle_dirty (void) {
+	struct thread *curr = thread_current ();
+	unsigned gen;
+
+	if (curr->mmap_dirty_cnt <= DIRTY_LIMIT || !flusher_started)
+		return;
+
+	throttle_cnt++;
+	lock_acquire (&flush_lock);
+	gen = flush_gen;
+	while (curr->mmap_dirty_cnt > DIRTY_LIMIT && flush_gen - gen < 2) {
+		flush_wanted = true;
+		cond_wait (&flush_done, &flush_lock);
+	}
+	lock_release (&flush_lock);
 }
 
 /* Do the mmap */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *end = pg_round_up ((uint8_t *) addr + length);
+	struct vm_region *region;
+	struct file *mfile;
+	size_t read_bytes;
+	off_t file_len;
+	uint8_t *upage;
+	bool start;
+
+	/* The mapping stays valid after the process closes FD. */
+	mfile = file_reopen (file);
+	if (mfile == NULL)
+		return NULL;
+	region = spt_add_region (spt, addr, end, REGION_MMAP, writable, mfile,
+			offset);
+	if (region == NULL) {
+		file_close (mfile);
+		return NULL;
+	}
+
+	/* The flusher starts with the first mapping.  Racing first mappings
+	 * agree on one of them under flush_lock. */
+	lock_acquire (&flush_lock);
+	start = !flusher_started;
+	flusher_started = true;
+	lock_release (&flush_lock);
+	if (start)
+		thread_create ("flusher", PRI_DEFAULT, flusher, NULL);
+
+	file_len = file_length (mfile);
+	read_bytes = offset < file_len ? (size_t) (file_len - offset) : 0;
+	if (read_bytes > length)
+		read_bytes = length;
+
+	for (upage = addr; upage < (uint8_t *) end; upage += PGSIZE) {
+		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+		struct lazy_load_info *info = malloc (sizeof *info);
+
+		if (info == NULL)
+			goto fail;
+		info->file = mfile;
+		info->ofs = offset;
+		info->read_bytes = page_read_bytes;
+		info->zero_bytes = PGSIZE - page_read_bytes;
+		if (!vm_alloc_page_with_initializer (VM_FILE, upage, writable,
+					file_lazy_load, info)) {
+			free (info);
+			goto fail;
+		}
+
+		read_bytes -= page_read_bytes;
+		offset += PGSIZE;
+	}
+	return addr;
+
+fail:
+	do_munmap (addr);
+	return NULL;
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vm_region *region = spt_find_region (spt, addr);
+	uint8_t *upage;
+
+	if (region == NULL || region->kind != REGION_MMAP || region->start != addr)
+		return;
+
+	/* Only the pages of this mapping are visited, not the whole table. */
+	for (upage = region->start; upage < (uint8_t *) region->end;
+			upage += PGSIZE) {
+		struct page *page = spt_find_page (spt, upage);
+		if (page != NULL)
+			spt_remove_page (spt, page);
+	}
+	spt_remove_region (spt, region);
+}
+
+/* Writes the dirty pages of the mapping that contains ADDR back to its
+ * file.  Returns false if ADDR is not in a mapping. */
+bool
+do_msync (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vm_region *region = spt_find_region (spt, addr);
+	uint8_t *upage;
+
+	if (region == NULL || region->kind != REGION_MMAP)
+		return false;
+
+	for (upage = region->start; upage < (uint8_t *) region->end;
+			upage += PGSIZE) {
+		struct page *page = spt_find_page (spt, upage);
+
+		/* Pages that are not resident have nothing to write. */
+		if (page == NULL || page->operations != &file_ops
+				|| !vm_pin_page (page))
+			continue;
+		if (file_write_back (page)) {
+			file_write_protect (page);
+			msync_page_cnt++;
+		}
+		vm_unpin_page (page);
+	}
+	return true;
+}
+
+/* Prints writeback statistics. */
+void
+file_print_stats (void) {
+	printf ("Writeback: %lld pages in %lld runs, %lld throttled writers, "
+			"%lld pages synced\n", flush_page_cnt, flush_run_cnt,
+			throttle_cnt, msync_page_cnt);
 }
@@ -5,6 +5,7 @@
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "vm/inspect.h"
+#include "vm/vm.h"
 
 static void
 inspect (struct intr_frame *f) {
@@ -21,3 +22,23 @@ void
 register_inspect_intr (void) {
 	intr_register_int (0x42, 3, INTR_OFF, inspect, "Inspect Virtual Memory");
 }
+
+static void
+inspect_faults (struct intr_frame *f) {
+	f->R.rax = vm_fault_stat (f->R.rdx != 0, f->R.rax != 0, f->R.rcx);
+}
+
+/* Tool for testing page fault statistics. Calling this function via
+ * int 0x45.
+ * Input:
+ *   @RAX - 0 for the faults of type RCX, 1 for the faults in latency
+ *          bucket RCX
+ *   @RCX - Fault type (FAULT_* in lib/user/syscall.h) or bucket
+ *   @RDX - 0 for the current process, 1 for the whole system
+ * Output:
+ *   @RAX - Number of faults. */
+void
+register_fault_inspect_intr (void) {
+	intr_register_int (0x45, 3, INTR_OFF, inspect_faults,
+			"Inspect Page Fault Statistics");
+}
@@ -0,0 +1,236 @@
+/* ksm.c: Same-page merging for anonymous memory.
+ *
+ * The ksmd thread walks the frame table a batch at a time and
+ * checksums each anonymous frame.  A frame whose contents match another
+ * is merged into it: its pages map the other frame read-only and it is
+ * freed, as if the two had been shared copy-on-write from the start.  A
+ * write splits the page off again in vm_handle_wp().
+ *
+ * Frames already merged sit in the stable table, where later duplicates
+ * find them.  Frames checksummed during the current pass sit in the
+ * unstable table; two that match there start a new stable frame.  All
+ * zero frames merge into the zero frame.  Frames are write-protected
+ * before they are compared, so a process cannot change them between the
+ * comparison and the merge. */
+
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "vm/vm.h"
+#include "devices/timer.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+/* Ticks between passes. */
+#define KSM_INTERVAL (TIMER_FREQ / 10)
+
+/* Most frames one pass checksums. */
+#define KSM_MAX_BATCH 512
+
+size_t ksm_pages_to_scan;
+
+/* Merged frames, hashed by checksum.  Protected by frame_lock. */
+static struct hash ksm_stable;
+
+/* Frames checksummed by the current pass. */
+static struct ksm_candidate {
+	uint64_t sum;
+	struct frame *frame;
+} unstable[KSM_MAX_BATCH];
+static size_t unstable_cnt;
+
+/* Checksum of a page of zeros. */
+static uint64_t zero_sum;
+
+/* Where the next pass starts in the frame table. */
+static size_t ksm_cursor;
+
+/* State of one pass over the frame table. */
+struct ksm_pass {
+	size_t skip;                /* Frames before the cursor. */
+	size_t budget;              /* Frames left to examine. */
+};
+
+/* Scanner statistics. */
+static long long scan_cnt;          /* Frames checksummed. */
+static uint64_t scan_cycles;        /* TSC cycles spent on them. */
+static long long merge_cnt;         /* Frames freed by merging. */
+static long long zero_merge_cnt;    /* Of those, merged into zero_frame. */
+static long long split_cnt;         /* Writes to merged frames. */
+
+static uint64_t ksm_hash (const struct hash_elem *e, void *aux);
+static bool ksm_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux);
+static void ksmd (void *aux);
+
+/* Returns the checksum of the page at KVA. */
+static uint64_t
+page_checksum (const void *kva) {
+	const uint64_t *p = kva;
+	uint64_t sum = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < PGSIZE / sizeof *p; i++)
+		sum = (sum ^ p[i]) * 0x100000001b3ULL;
+	return sum;
+}
+
+/* Initializes the scanner, and starts it if -ksm asked for it. */
+void
+ksm_init (void) {
+	static const uint64_t zeros[PGSIZE / sizeof (uint64_t)];
+
+	hash_init (&ksm_stable, ksm_hash, ksm_less, NULL);
+	zero_sum = page_checksum (zeros);
+	if (ksm_pages_to_scan > KSM_MAX_BATCH)
+		ksm_pages_to_scan = KSM_MAX_BATCH;
+	if (ksm_pages_to_scan > 0)
+		thread_create ("ksmd", PRI_MIN, ksmd, NULL);
+}
+
+/* Removes FRAME from the stable table, because it is about to be
+ * written or released.  Must be called with frame_lock held. */
+void
+ksm_forget (struct frame *frame) {
+	hash_delete (&ksm_stable, &frame->ksm_elem);
+	frame->ksm = false;
+}
+
+/* Counts a write fault on a merged frame. */
+void
+ksm_note_split (void) {
+	split_cnt++;
+}
+
+/* Returns true if FRAME holds the same bytes as OTHER.  Both are
+ * protected first: a stable frame is not assumed to be still protected,
+ * so that no page can write to it once more pages share it. */
+static bool
+same_contents (struct frame *frame, struct frame *other) {
+	vm_protect_frame (frame);
+	vm_protect_frame (other);
+	return !memcmp (frame->kva, other->kva, PGSIZE);
+}
+
+/* Merges FRAME into an identical frame, if one is known, or records it
+ * in the unstable table.  Must be called with frame_lock held. */
+static void
+ksm_scan_frame (struct frame *frame) {
+	struct hash_elem *e;
+	uint64_t sum = page_checksum (frame->kva);
+	size_t i;
+
+	scan_cnt++;
+	if (sum == zero_sum) {
+		static const uint64_t zeros[PGSIZE / sizeof (uint64_t)];
+
+		vm_protect_frame (frame);
+		if (!memcmp (frame->kva, zeros, PGSIZE)) {
+			vm_merge_frame (frame, NULL);
+			merge_cnt++;
+			zero_merge_cnt++;
+		}
+		return;
+	}
+
+	frame->ksm_sum = sum;
+	e = hash_find (&ksm_stable, &frame->ksm_elem);
+	if (e != NULL) {
+		struct frame *stable = hash_entry (e, struct frame, ksm_elem);
+
+		if (same_contents (frame, stable)) {
+			vm_merge_frame (frame, stable);
+			merge_cnt++;
+		}
+		return;
+	}
+
+	for (i = 0; i < unstable_cnt; i++) {
+		struct frame *other = unstable[i].frame;
+
+		if (unstable[i].sum != sum || other == NULL)
+			continue;
+		if (!same_contents (frame, other))
+			continue;
+
+		/* OTHER becomes the stable copy of these contents. */
+		other->ksm_sum = sum;
+		other->ksm = true;
+		hash_insert (&ksm_stable, &other->ksm_elem);
+		unstable[i].frame = NULL;
+		vm_merge_frame (frame, other);
+		merge_cnt++;
+		return;
+	}
+	if (unstable_cnt < KSM_MAX_BATCH) {
+		unstable[unstable_cnt].sum = sum;
+		unstable[unstable_cnt++].frame = frame;
+	}
+}
+
+/* Examines FRAME if the pass has reached the cursor.  Returns false
+ * once the pass has used up its budget.  Called by vm_for_each_frame()
+ * with frame_lock held. */
+static bool
+ksm_visit (struct frame *frame, void *aux) {
+	struct ksm_pass *pass = aux;
+
+	if (pass->skip > 0) {
+		pass->skip--;
+		return true;
+	}
+	if (pass->budget == 0)
+		return false;
+	pass->budget--;
+	ksm_cursor++;
+	if (!frame->ksm && vm_frame_is_mergeable (frame))
+		ksm_scan_frame (frame);
+	return true;
+}
+
+/* The scanner thread.  Every KSM_INTERVAL ticks it examines the next
+ * ksm_pages_to_scan frames of the frame table, wrapping around at its
+ * end.  It runs at the lowest priority, so it uses only idle time. */
+static void
+ksmd (void *aux UNUSED) {
+	for (;;) {
+		struct ksm_pass pass;
+		uint64_t start;
+
+		timer_sleep (KSM_INTERVAL);
+		pass.skip = ksm_cursor;
+		pass.budget = ksm_pages_to_scan;
+		unstable_cnt = 0;
+
+		start = rdtsc ();
+		vm_for_each_frame (ksm_visit, &pass);
+		scan_cycles += rdtsc () - start;
+		if (pass.budget > 0)
+			ksm_cursor = 0;
+	}
+}
+
+/* Hashes a stable frame by checksum. */
+static uint64_t
+ksm_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct frame *frame = hash_entry (e, struct frame, ksm_elem);
+
+	return frame->ksm_sum;
+}
+
+/* Orders stable frames by checksum. */
+static bool
+ksm_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct frame, ksm_elem)->ksm_sum
+		< hash_entry (b, struct frame, ksm_elem)->ksm_sum;
+}
+
+/* Prints scanner statistics. */
+void
+ksm_print_stats (void) {
+	printf ("KSM: %lld frames scanned, %llu cycles/frame, %lld merged "
+			"(%lld into the zero page), %lld split on write\n", scan_cnt,
+			scan_cnt > 0 ? scan_cycles / scan_cnt : 0, merge_cnt,
+			zero_merge_cnt, split_cnt);
+}
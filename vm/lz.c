@@ -0,0 +1,133 @@
+/* lz.c: Small LZ77 codec for compressing pages in memory.
+ *
+ * The output is a series of groups, each a control byte followed by up
+ * to eight items.  Bit I of the control byte, counting from the least
+ * significant, describes item I: 0 for a literal byte, 1 for a back
+ * reference.  A back reference is a 12-bit distance and a 4-bit length
+ * code in two bytes; the largest code is followed by a byte that
+ * extends the length, so runs such as zero fill compress well.  The
+ * format favors speed over ratio; one pass with a single-probe hash
+ * table, no entropy coding. */
+
+#include "vm/lz.h"
+#include <debug.h>
+#include <string.h>
+
+#define MIN_MATCH 3             /* Shortest back reference. */
+#define LONG_MATCH 18           /* Shortest reference with a length byte. */
+#define MAX_MATCH (LONG_MATCH + 255) /* Longest back reference. */
+#define NO_POS 0xffff           /* Empty match table entry. */
+
+/* Hashes the three bytes at P into the match table. */
+static inline unsigned
+hash3 (const uint8_t *p) {
+	uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+	return (v * 2654435761u) >> 22 & (LZ_HASH_SIZE - 1);
+}
+
+/* Compresses the LEN bytes at SRC into DST, which has room for CAP
+ * bytes.  TABLE is scratch space, so that callers can keep it off the
+ * small kernel stack.  Returns the compressed length, or 0 if the output
+ * would not fit in CAP bytes. */
+size_t
+lz_compress (const void *src_, size_t len, void *dst_, size_t cap,
+		uint16_t table[LZ_HASH_SIZE]) {
+	const uint8_t *src = src_;
+	const uint8_t *ip = src, *end = src + len;
+	uint8_t *dst = dst_;
+	uint8_t *op = dst, *dst_end = dst + cap;
+	uint8_t *ctrl = NULL;
+	int bit = 8;
+
+	ASSERT (len <= LZ_MAX_INPUT);
+
+	memset (table, 0xff, LZ_HASH_SIZE * sizeof *table);
+	while (ip < end) {
+		if (bit == 8) {
+			if (op >= dst_end)
+				return 0;
+			ctrl = op++;
+			*ctrl = 0;
+			bit = 0;
+		}
+
+		if (end - ip >= MIN_MATCH) {
+			unsigned h = hash3 (ip);
+			size_t cand = table[h];
+
+			table[h] = ip - src;
+			if (cand != NO_POS && !memcmp (src + cand, ip, MIN_MATCH)) {
+				size_t max = end - ip < MAX_MATCH ? (size_t) (end - ip)
+					: MAX_MATCH;
+				size_t dist = ip - (src + cand);
+				size_t mlen = MIN_MATCH;
+
+				while (mlen < max && src[cand + mlen] == ip[mlen])
+					mlen++;
+				if (dst_end - op < (mlen >= LONG_MATCH ? 3 : 2))
+					return 0;
+				*op++ = dist >> 4;
+				if (mlen >= LONG_MATCH) {
+					*op++ = (dist & 0xf) << 4 | (LONG_MATCH - MIN_MATCH);
+					*op++ = mlen - LONG_MATCH;
+				} else
+					*op++ = (dist & 0xf) << 4 | (mlen - MIN_MATCH);
+				*ctrl |= 1 << bit++;
+				ip += mlen;
+				continue;
+			}
+		}
+
+		if (op >= dst_end)
+			return 0;
+		*op++ = *ip++;
+		bit++;
+	}
+	return op - dst;
+}
+
+/* Decompresses the LEN bytes at SRC, which must expand to exactly
+ * DST_LEN bytes, into DST.  Returns false if SRC is malformed. */
+bool
+lz_decompress (const void *src_, size_t len, void *dst_, size_t dst_len) {
+	const uint8_t *ip = src_, *src_end = ip + len;
+	uint8_t *dst = dst_;
+	uint8_t *op = dst, *end = dst + dst_len;
+
+	while (op < end) {
+		uint8_t ctrl;
+		int bit;
+
+		if (ip >= src_end)
+			return false;
+		ctrl = *ip++;
+		for (bit = 0; bit < 8 && op < end; bit++) {
+			if (ctrl & (1 << bit)) {
+				size_t dist, mlen;
+
+				if (src_end - ip < 2)
+					return false;
+				dist = ip[0] << 4 | ip[1] >> 4;
+				mlen = (ip[1] & 0xf) + MIN_MATCH;
+				ip += 2;
+				if (mlen == LONG_MATCH) {
+					if (ip >= src_end)
+						return false;
+					mlen += *ip++;
+				}
+				if (dist == 0 || dist > (size_t) (op - dst)
+						|| mlen > (size_t) (end - op))
+					return false;
+
+				/* The reference may overlap the bytes it produces. */
+				for (; mlen > 0; mlen--, op++)
+					*op = op[-dist];
+			} else {
+				if (ip >= src_end)
+					return false;
+				*op++ = *ip++;
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,170 @@
+/* oom.c: Memory pressure handling.
+ *
+ * Two watermarks on the user pool drive reclaim.  When an allocation
+ * leaves fewer free pages than the low mark, the kswapd thread wakes up
+ * and evicts frames until the high mark is free again, so that faults
+ * seldom have to evict anything themselves.
+ *
+ * When a fault finds no free page and nothing to evict, because every
+ * frame is pinned or the swap disk is full, the OOM killer picks the
+ * runnable process that holds the most memory, resident and swapped,
+ * and marks it.  A marked process exits at its next system call or page
+ * fault, which frees its memory; the faulting process waits for that.
+ * If the faulting process is the one marked, its fault fails instead,
+ * so that it exits from the page fault handler with no locks held.
+ * A blocked process, say one in wait() or reading the console, might
+ * not get there for a long time, so it is never picked. */
+
+#include <stdio.h>
+#include "vm/vm.h"
+#include "vm/oom.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Ticks to wait for a marked process to exit before choosing another. */
+#define OOM_PATIENCE (2 * TIMER_FREQ)
+
+/* Free user pool pages below which kswapd starts, and up to which it
+ * reclaims. */
+static size_t low_mark, high_mark;
+
+static struct semaphore kswapd_sema;  /* Upped to wake kswapd. */
+static bool kswapd_busy;              /* Woken and not yet done? */
+
+/* Serializes OOM kills, so that faults that run out of memory together
+ * kill one process, not one each. */
+static struct lock oom_lock;
+
+/* Statistics. */
+static long long kswapd_wake_cnt;     /* Times kswapd was woken. */
+static long long kswapd_reclaim_cnt;  /* Frames it freed. */
+static long long oom_kill_cnt;        /* Processes killed. */
+
+/* The process the OOM killer has chosen so far. */
+struct oom_choice {
+	struct thread *victim;
+	size_t badness;
+};
+
+static void kswapd (void *aux);
+
+/* Sets the watermarks from the size of the user pool and starts
+ * kswapd.  Must be called before any user page is allocated. */
+void
+oom_init (void) {
+	size_t pages = palloc_free_cnt (PAL_USER);
+
+	low_mark = pages / 64 + 2;
+	high_mark = pages / 32 + 4;
+	sema_init (&kswapd_sema, 0);
+	lock_init (&oom_lock);
+	thread_create ("kswapd", PRI_DEFAULT, kswapd, NULL);
+}
+
+/* Wakes kswapd if the user pool has fallen below the low mark. */
+void
+oom_check_watermark (void) {
+	if (!kswapd_busy && palloc_free_cnt (PAL_USER) < low_mark) {
+		kswapd_busy = true;
+		kswapd_wake_cnt++;
+		sema_up (&kswapd_sema);
+	}
+}
+
+/* Background reclaim: evicts frames whenever the user pool falls below
+ * the low mark, until it is back above the high mark or nothing more
+ * can be evicted. */
+static void
+kswapd (void *aux UNUSED) {
+	for (;;) {
+		sema_down (&kswapd_sema);
+		while (palloc_free_cnt (PAL_USER) < high_mark && vm_reclaim_frame ())
+			kswapd_reclaim_cnt++;
+		kswapd_busy = false;
+	}
+}
+
+/* Rates process T and makes it CHOICE's victim if it holds more memory
+ * than the victim so far.  Kernel threads, processes that are already
+ * exiting, processes already marked and blocked processes, which would
+ * not exit soon, are left alone. */
+static void
+oom_rate (struct thread *t, void *choice_) {
+	struct oom_choice *choice = choice_;
+	size_t badness;
+
+	if (t->pml4 == NULL || t->oom_killed || t->status == THREAD_DYING
+			|| t->status == THREAD_BLOCKED)
+		return;
+	badness = t->rss_cnt + t->swap_cnt;
+	if (choice->victim == NULL || badness > choice->badness) {
+		choice->victim = t;
+		choice->badness = badness;
+	}
+}
+
+/* Clears *TID_ if T is the thread with that tid and has not exited. */
+static void
+oom_find (struct thread *t, void *tid_) {
+	tid_t *tid = tid_;
+
+	if (t->tid == *tid && t->status != THREAD_DYING)
+		*tid = TID_ERROR;
+}
+
+/* Returns true if the thread with TID has not exited yet. */
+static bool
+victim_alive (tid_t tid) {
+	enum intr_level old_level = intr_disable ();
+
+	thread_foreach (oom_find, &tid);
+	intr_set_level (old_level);
+	return tid == TID_ERROR;
+}
+
+/* Frees memory for a fault that found none by killing the process with
+ * the most resident and swapped pages.  Returns once that process has
+ * exited, or after OOM_PATIENCE ticks if it has not, so the caller can
+ * try again.  If the current process is the one killed, or was marked
+ * already, returns at once: the caller must then fail its fault. */
+void
+oom_kill (void) {
+	struct thread *curr = thread_current ();
+	struct oom_choice choice = { NULL, 0 };
+	enum intr_level old_level;
+	int64_t start;
+	tid_t tid;
+
+	if (curr->oom_killed)
+		return;
+
+	lock_acquire (&oom_lock);
+	old_level = intr_disable ();
+	thread_foreach (oom_rate, &choice);
+	if (choice.victim == NULL)
+		choice.victim = curr;
+	choice.victim->oom_killed = true;
+	tid = choice.victim->tid;
+	intr_set_level (old_level);
+	oom_kill_cnt++;
+
+	if (choice.victim == curr) {
+		lock_release (&oom_lock);
+		return;
+	}
+	start = timer_ticks ();
+	while (victim_alive (tid) && timer_elapsed (start) < OOM_PATIENCE)
+		timer_sleep (1);
+	lock_release (&oom_lock);
+}
+
+/* Prints memory pressure statistics. */
+void
+oom_print_stats (void) {
+	printf ("OOM: kswapd woken %lld times, %lld frames reclaimed, "
+			"%lld processes killed\n", kswapd_wake_cnt, kswapd_reclaim_cnt,
+			oom_kill_cnt);
+}
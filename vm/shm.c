@@ -0,0 +1,192 @@
+/* shm.c: Anonymous mappings, private or shared with forked children. */
+
+#include <string.h>
+#include "vm/vm.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+static bool shm_swap_in (struct page *page, void *kva);
+static bool shm_swap_out (struct page *page);
+static void shm_destroy (struct page *page);
+
+static const struct page_operations shm_ops = {
+	.swap_in = shm_swap_in,
+	.swap_out = shm_swap_out,
+	.destroy = shm_destroy,
+	.type = VM_SHM,
+};
+
+/* Creates an object of PAGE_CNT zero pages, with one reference.
+ * Returns a null pointer if memory runs out. */
+static struct shm_object *
+shm_create (size_t page_cnt) {
+	struct shm_object *obj;
+
+	obj = malloc (sizeof *obj + page_cnt * sizeof *obj->pages);
+	if (obj == NULL)
+		return NULL;
+	lock_init (&obj->lock);
+	obj->ref_cnt = 1;
+	for (obj->page_cnt = 0; obj->page_cnt < page_cnt; obj->page_cnt++) {
+		struct page *master = calloc (1, sizeof *master);
+
+		if (master == NULL) {
+			shm_put (obj);
+			return NULL;
+		}
+		/* Reads back as zeros until first loaded. */
+		anon_adopt (master);
+		master->anon.zero = true;
+		obj->pages[obj->page_cnt] = master;
+	}
+	return obj;
+}
+
+/* Adds a reference to OBJ and returns it. */
+struct shm_object *
+shm_get (struct shm_object *obj) {
+	lock_acquire (&obj->lock);
+	obj->ref_cnt++;
+	lock_release (&obj->lock);
+	return obj;
+}
+
+/* Drops a reference to OBJ, freeing it with the last one.  The pages
+ * of the regions that referred to it must already be gone. */
+void
+shm_put (struct shm_object *obj) {
+	bool last;
+	size_t i;
+
+	lock_acquire (&obj->lock);
+	last = --obj->ref_cnt == 0;
+	lock_release (&obj->lock);
+	if (!last)
+		return;
+
+	for (i = 0; i < obj->page_cnt; i++) {
+		struct page *master = obj->pages[i];
+
+		vm_free_master_frame (master);
+		destroy (master);
+		free (master);
+	}
+	free (obj);
+}
+
+/* Returns the object behind PAGE, a shared memory page, initialized or
+ * not, and stores the page's index in it in *IDX. */
+struct shm_object *
+shm_locate (struct page *page, size_t *idx) {
+	struct vm_region *region;
+
+	if (page->operations == &shm_ops) {
+		*idx = page->shm.idx;
+		return page->shm.obj;
+	}
+	region = spt_find_region (&page->owner->spt, page->va);
+	*idx = ((uint8_t *) page->va - (uint8_t *) region->start) / PGSIZE;
+	return region->shm;
+}
+
+/* Returns the master page of PAGE, a shared memory page. */
+struct page *
+shm_master (struct page *page) {
+	size_t idx;
+	struct shm_object *obj = shm_locate (page, &idx);
+
+	return obj->pages[idx];
+}
+
+/* Initialize the shared memory page.  The contents come from the
+ * master page, through shm_load(). */
+bool
+shm_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
+	struct shm_page *shm_page = &page->shm;
+
+	shm_page->obj = shm_locate (page, &shm_page->idx);
+	page->operations = &shm_ops;
+	return true;
+}
+
+/* Loads a shared memory page on the first fault of its process. */
+bool
+shm_load (struct page *page, void *aux UNUSED) {
+	return shm_swap_in (page, page->frame->kva);
+}
+
+/* Swap in the page from its master page. */
+static bool
+shm_swap_in (struct page *page, void *kva) {
+	struct page *master = shm_master (page);
+
+	return swap_in (master, kva);
+}
+
+/* Shared frames are evicted as a whole by the frame table, which swaps
+ * the master page out instead. */
+static bool
+shm_swap_out (struct page *page UNUSED) {
+	return false;
+}
+
+/* Destroy the shared memory page.  While other regions still map the
+ * object, the last page to leave a frame leaves its contents to the
+ * master page.
+ * PAGE will be freed by the caller. */
+static void
+shm_destroy (struct page *page) {
+	struct shm_object *obj = page->shm.obj;
+
+	lock_acquire (&obj->lock);
+	vm_free_shared_frame (page, obj->ref_cnt > 1);
+	lock_release (&obj->lock);
+}
+
+/* Unmaps PAGE, a shared memory page, from its process.  The contents
+ * stay with the object, and the next fault maps them again. */
+void
+shm_release (struct page *page) {
+	struct shm_object *obj = page->shm.obj;
+
+	lock_acquire (&obj->lock);
+	vm_free_shared_frame (page, true);
+	lock_release (&obj->lock);
+}
+
+/* Maps LENGTH bytes of zero pages at ADDR, shared with forked children
+ * if SHARED, or copied on fork like any anonymous memory otherwise.
+ * Returns ADDR, or a null pointer on failure. */
+void *
+do_mmap_anon (void *addr, size_t length, bool writable, bool shared) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *end = pg_round_up ((uint8_t *) addr + length);
+	struct vm_region *region;
+	uint8_t *upage;
+
+	region = spt_add_region (spt, addr, end, REGION_MMAP, writable, NULL, 0);
+	if (region == NULL)
+		return NULL;
+	if (shared) {
+		region->shm = shm_create (pg_no (end) - pg_no (addr));
+		if (region->shm == NULL)
+			goto fail;
+	}
+
+	for (upage = addr; upage < (uint8_t *) end; upage += PGSIZE) {
+		bool success = shared
+			? vm_alloc_page_with_initializer (VM_SHM, upage, writable,
+					shm_load, NULL)
+			: vm_alloc_page (VM_ANON, upage, writable);
+
+		if (!success)
+			goto fail;
+	}
+	return addr;
+
+fail:
+	do_munmap (addr);
+	return NULL;
+}
@@ -3,3 +3,7 @@ vm_SRC += vm/uninit.c     # Uninitialized page
 vm_SRC += vm/anon.c       # Anonymous page
 vm_SRC += vm/file.c       # File mapped page
 vm_SRC += vm/inspect.c    # Testing utility
+vm_SRC += vm/lz.c         # Page compression codec
+vm_SRC += vm/shm.c        # Anonymous and shared memory mappings
+vm_SRC += vm/ksm.c        # Same-page merging scanner
+vm_SRC += vm/oom.c        # Background reclaim and OOM killer
@@ -1,8 +1,101 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <bitmap.h>
+#include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/oom.h"
+#include "intrinsic.h"
+
+/* Most anonymous pages evicted in one batch. */
+#define EVICT_CLUSTER 8
+
+/* Pages in the aligned block around a fault that fault-around maps. */
+#define FAULT_AROUND 16
+
+/* Read-ahead window bounds, in pages. */
+#define RA_MIN 4
+#define RA_MAX 32
+
+/* Sequential faults in a row that a region takes before read-ahead
+ * starts, so that touching the first few pages of a mapping, in order,
+ * still loads only the pages touched. */
+#define RA_RUN 4
+
+/* Every frame that holds a user page, in CLOCK order.  Eviction walks
+ * this list instead of the processes' page tables, so its cost does not
+ * grow with the number of processes. */
+static struct list frame_table;
+static struct list_elem *clock_hand;  /* Next frame the CLOCK looks at. */
+
+/* Protects frame_table, clock_hand and the frame/page links.  Eviction
+ * holds it for its whole duration, except while it writes anonymous pages
+ * to swap: their frames are pinned and marked EVICTING meanwhile, and a
+ * thread about to change the links of such a frame waits on evict_done
+ * until the write is over. */
+static struct lock frame_lock;
+static struct condition evict_done;
+
+/* Frames holding executable segment pages, by file position, so that
+ * processes running the same program share one copy.  Protected by
+ * frame_lock. */
+static struct hash seg_cache;
+
+/* A frame of zeros, mapped read-only by anonymous pages that have only
+ * been read.  It is not in the frame table, so it is never evicted, and
+ * it stays pinned. */
+static struct frame zero_frame;
+static uint64_t seg_hash (const struct hash_elem *e, void *aux);
+static bool seg_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux);
+
+/* -pfstat: Print each process's fault statistics when it exits? */
+bool vm_fault_stats_on_exit;
+
+/* Fault statistics.  Each process also keeps its own, in its struct
+ * thread. */
+static long long fault_cnt;         /* Faults resolved by vm_try_handle_fault. */
+static uint64_t fault_cycles;       /* TSC cycles spent resolving them. */
+static long long fault_type_cnt[VM_FAULT_TYPE_CNT];
+static uint64_t fault_hist[VM_FAULT_TYPE_CNT][FAULT_HIST_BUCKETS];
+
+static const char *fault_type_names[VM_FAULT_TYPE_CNT] = {
+	"minor", "major", "zero", "cow", "stack", "invalid",
+};
+
+/* Eviction statistics. */
+static long long victims_scanned;   /* Frames examined by the CLOCK. */
+static long long clean_evict_cnt;   /* Evictions that needed no I/O. */
+static long long dirty_evict_cnt;   /* Evictions that wrote the page out. */
+static long long refault_cnt;       /* Faults on previously evicted pages. */
+static long long limit_evict_cnt;   /* Evictions to keep under rss_limit. */
+
+/* Copy-on-write statistics. */
+static long long fork_cnt;          /* Address spaces copied by fork. */
+static uint64_t fork_cycles;        /* TSC cycles spent copying them. */
+static long long cow_share_cnt;     /* Frames shared instead of copied. */
+static long long cow_copy_cnt;      /* Frames copied on a write fault. */
+static long long zero_map_cnt;      /* Read faults served by zero_frame. */
+static long long zero_copy_cnt;     /* Writes that left zero_frame. */
+
+/* Segment cache statistics. */
+static long long seg_share_cnt;     /* Segment faults served from the cache. */
+static long long seg_load_cnt;      /* Segment pages read from the file. */
+static long long seg_drop_cnt;      /* Cached frames dropped by eviction. */
+
+/* Prefetch statistics. */
+static long long around_cnt;        /* Pages mapped by fault-around. */
+static long long readahead_cnt;     /* File pages read ahead of a fault. */
+static long long drop_behind_cnt;   /* Pages aged behind a sequential scan. */
+
+/* madvise() statistics. */
+static long long willneed_cnt;      /* Pages prefetched on request. */
+static long long dontneed_cnt;      /* Pages released on request. */
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -15,7 +108,21 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	list_init (&frame_table);
+	lock_init (&frame_lock);
+	cond_init (&evict_done);
+	zero_frame.kva = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	zero_frame.page = NULL;
+	list_init (&zero_frame.pages);
+	zero_frame.pin_cnt = 1;
+	zero_frame.evicting = false;
+	zero_frame.seg_inode = NULL;
+	zero_frame.ksm = false;
+	clock_hand = list_end (&frame_table);
+	hash_init (&seg_cache, seg_hash, seg_less, NULL);
+	ksm_init ();
+	oom_init ();
+	register_fault_inspect_intr ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -33,9 +140,43 @@ page_get_type (struct page *page) {
 }
 
 /* Helpers */
-static struct frame *vm_get_victim (void);
+static struct frame *vm_get_victim (struct thread *owner);
+static void fault_around (struct supplemental_page_table *spt,
+		struct page *page);
 static bool vm_do_claim_page (struct page *page);
-static struct frame *vm_evict_frame (void);
+static struct frame *vm_evict_frame (struct thread *owner);
+
+/* Creates a pending page of the current process for UPAGE, without
+ * adding it to the supplemental page table.  Returns a null pointer if
+ * TYPE is unknown or memory runs out. */
+static struct page *
+page_new (enum vm_type type, void *upage, bool writable,
+		vm_initializer *init, void *aux) {
+	bool (*initializer) (struct page *, enum vm_type, void *);
+	struct page *page;
+
+	switch (VM_TYPE (type)) {
+		case VM_ANON:
+			initializer = anon_initializer;
+			break;
+		case VM_FILE:
+			initializer = file_backed_initializer;
+			break;
+		case VM_SHM:
+			initializer = shm_initializer;
+			break;
+		default:
+			return NULL;
+	}
+
+	page = malloc (sizeof *page);
+	if (page == NULL)
+		return NULL;
+	uninit_new (page, upage, init, type, aux, initializer);
+	page->writable = writable;
+	page->owner = thread_current ();
+	return page;
+}
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -50,11 +191,15 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+		struct page *page = page_new (type, upage, writable, init, aux);
 
-		/* TODO: Insert the page into the spt. */
+		if (page == NULL)
+			goto err;
+		if (!spt_insert_page (spt, page)) {
+			free (page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
@@ -62,82 +207,1019 @@ err:
 
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page key;
+	struct hash_elem *e;
 
-	return page;
+	key.va = pg_round_down (va);
+	e = hash_find (&spt->pages, &key.spt_elem);
+	return e != NULL ? hash_entry (e, struct page, spt_elem) : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
-
-	return succ;
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	ASSERT (pg_ofs (page->va) == 0);
+	return hash_insert (&spt->pages, &page->spt_elem) == NULL;
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	hash_delete (&spt->pages, &page->spt_elem);
 	vm_dealloc_page (page);
+}
+
+/* Orders regions by start address. */
+static bool
+region_less (const struct list_elem *a_, const struct list_elem *b_,
+		void *aux UNUSED) {
+	const struct vm_region *a = list_entry (a_, struct vm_region, elem);
+	const struct vm_region *b = list_entry (b_, struct vm_region, elem);
+	return a->start < b->start;
+}
+
+/* The region tree is a treap keyed by start address: a binary search
+ * tree that is also a heap on a priority drawn from each region's
+ * address, which keeps it balanced in expectation.  Regions never
+ * overlap, so the region that starts last at or before an address is
+ * the only one that may contain it. */
+
+/* Returns REGION's heap priority in the region tree. */
+static uint64_t
+region_prio (const struct vm_region *region) {
+	return hash_bytes (&region, sizeof region);
+}
+
+/* Splits the region tree ROOT into the regions that start before KEY,
+ * stored in *LEFT, and the others, stored in *RIGHT. */
+static void
+region_split (struct vm_region *root, const void *key,
+		struct vm_region **left, struct vm_region **right) {
+	if (root == NULL)
+		*left = *right = NULL;
+	else if (root->start < key) {
+		region_split (root->right, key, &root->right, right);
+		*left = root;
+	} else {
+		region_split (root->left, key, left, &root->left);
+		*right = root;
+	}
+}
+
+/* Joins the region trees LEFT and RIGHT, whose regions all start before
+ * those of RIGHT, and returns the result. */
+static struct vm_region *
+region_merge (struct vm_region *left, struct vm_region *right) {
+	if (left == NULL)
+		return right;
+	if (right == NULL)
+		return left;
+	if (region_prio (left) > region_prio (right)) {
+		left->right = region_merge (left->right, right);
+		return left;
+	}
+	right->left = region_merge (left, right->left);
+	return right;
+}
+
+/* Returns the region of SPT that starts last at or before VA, or a null
+ * pointer if none does. */
+static struct vm_region *
+region_floor (struct supplemental_page_table *spt, const void *va) {
+	struct vm_region *node = spt->region_root, *found = NULL;
+
+	while (node != NULL)
+		if (node->start <= va) {
+			found = node;
+			node = node->right;
+		} else
+			node = node->left;
+	return found;
+}
+
+/* Records the region [START, END) in SPT.  The region takes ownership of
+ * FILE, which may be null.  Returns the new region, or a null pointer if
+ * the range overlaps an existing region or memory runs out. */
+struct vm_region *
+spt_add_region (struct supplemental_page_table *spt, void *start, void *end,
+		enum vm_region_kind kind, bool writable, struct file *file,
+		off_t offset) {
+	struct vm_region *region, *left, *right;
+
+	ASSERT (pg_ofs (start) == 0);
+	ASSERT (pg_ofs (end) == 0);
+
+	if (start >= end || !spt_range_is_free (spt, start, end))
+		return NULL;
+
+	region = malloc (sizeof *region);
+	if (region == NULL)
+		return NULL;
+	region->start = start;
+	region->end = end;
+	region->kind = kind;
+	region->writable = writable;
+	region->file = file;
+	region->offset = offset;
+	region->shm = NULL;
+	region->advice = VM_ADV_NORMAL;
+	region->ra_next = NULL;
+	region->ra_run = 0;
+	region->ra_window = 0;
+	list_insert_ordered (&spt->regions, &region->elem, region_less, NULL);
+
+	region->left = region->right = NULL;
+	region_split (spt->region_root, start, &left, &right);
+	spt->region_root = region_merge (region_merge (left, region), right);
+	return region;
+}
+
+/* Returns the region of SPT that contains VA, or a null pointer. */
+struct vm_region *
+spt_find_region (struct supplemental_page_table *spt, const void *va) {
+	struct vm_region *region = region_floor (spt, va);
+
+	return region != NULL && va < region->end ? region : NULL;
+}
+
+/* Returns true if no region of SPT overlaps [START, END). */
+bool
+spt_range_is_free (struct supplemental_page_table *spt, const void *start,
+		const void *end) {
+	struct vm_region *region;
+
+	if (start >= end)
+		return true;
+	region = region_floor (spt, (const uint8_t *) end - 1);
+	return region == NULL || region->end <= start;
+}
+
+/* Forgets REGION and closes its file or drops its shared memory.  The
+ * pages in the region must already be gone. */
+void
+spt_remove_region (struct supplemental_page_table *spt,
+		struct vm_region *region) {
+	struct vm_region *left, *middle, *right;
+
+	region_split (spt->region_root, region->start, &left, &middle);
+	region_split (middle, region->end, &middle, &right);
+	ASSERT (middle == region);
+	spt->region_root = region_merge (left, right);
+	list_remove (&region->elem);
+	file_close (region->file);
+	if (region->shm != NULL)
+		shm_put (region->shm);
+	free (region);
+}
+
+/* Returns the frame under the CLOCK hand and advances the hand,
+ * wrapping around at the end of the frame table. */
+static struct frame *
+clock_advance (void) {
+	if (clock_hand == list_end (&frame_table))
+		clock_hand = list_begin (&frame_table);
+	struct frame *frame = list_entry (clock_hand, struct frame, elem);
+	clock_hand = list_next (clock_hand);
+	return frame;
+}
+
+/* Adds PAGE to the pages sharing FRAME.  Must be called with frame_lock
+ * held. */
+static void
+frame_link (struct frame *frame, struct page *page) {
+	list_push_back (&frame->pages, &page->frame_elem);
+	frame->page = list_entry (list_front (&frame->pages), struct page,
+			frame_elem);
+	page->frame = frame;
+	if (page->owner != NULL && frame != &zero_frame)
+		page->owner->rss_cnt++;
+}
+
+/* Removes PAGE from the pages sharing its frame.  Returns true if no page
+ * is left.  Must be called with frame_lock held. */
+static bool
+frame_unlink (struct page *page) {
+	struct frame *frame = page->frame;
+
+	list_remove (&page->frame_elem);
+	page->frame = NULL;
+	if (page->owner != NULL && frame != &zero_frame)
+		page->owner->rss_cnt--;
+	frame->page = list_empty (&frame->pages) ? NULL
+		: list_entry (list_front (&frame->pages), struct page, frame_elem);
+	return frame->page == NULL;
+}
+
+/* Waits until PAGE's frame, if it has one, is not being evicted any
+ * more.  Must be called with frame_lock held. */
+static void
+frame_wait_evict (struct page *page) {
+	while (page->frame != NULL && page->frame->evicting)
+		cond_wait (&evict_done, &frame_lock);
+}
+
+/* Returns true if more than one page maps FRAME. */
+static bool
+frame_is_shared (struct frame *frame) {
+	return list_front (&frame->pages) != list_back (&frame->pages);
+}
+
+/* Maps PAGE to KVA with RW permission, keeping the dirty bit. */
+static void
+remap_page (struct page *page, void *kva, bool rw) {
+	uint64_t *pml4 = page->owner->pml4;
+	bool dirty = pml4_is_dirty (pml4, page->va);
+
+	/* Clearing first flushes the stale TLB entry. */
+	pml4_clear_page (pml4, page->va);
+	pml4_set_page (pml4, page->va, kva, rw);
+	if (dirty)
+		pml4_set_dirty (pml4, page->va, true);
+}
+
+/* Returns true if any page of FRAME was accessed since the last call,
+ * and clears their accessed bits. */
+static bool
+frame_test_and_clear_accessed (struct frame *frame) {
+	bool accessed = false;
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4_is_accessed (pml4, page->va)) {
+			pml4_set_accessed (pml4, page->va, false);
+			accessed = true;
+		}
+	}
+	return accessed;
+}
+
+/* Returns true if evicting FRAME requires writing it out. */
+static bool
+frame_is_dirty (struct frame *frame) {
+	struct page *page = frame->page;
+
+	if (page_get_type (page) != VM_FILE)
+		return true;
+	return page->file.dirty;
+}
+
+/* Get the struct frame, that will be evicted.
+ *
+ * Second-chance CLOCK: a frame whose accessed bit is set has the bit
+ * cleared and is passed over.  The first lap also passes over dirty
+ * frames, so clean pages, which cost no I/O, go first.  A frame shared
+ * copy-on-write by anonymous pages goes to swap once for each sharer, so
+ * it is a candidate only if it has at most EVICT_CLUSTER sharers; other
+ * shared file frames are left alone.  Shared segment frames are
+ * candidates, since eviction just drops them, and so are shared memory
+ * frames, which go to swap through their master page.  If OWNER is not
+ * null, only
+ * frames whose first page belongs to OWNER are candidates.  Must be
+ * called with frame_lock held. */
+static struct frame *
+vm_get_victim (struct thread *owner) {
+	size_t frame_cnt = list_size (&frame_table);
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (i = 0; i < 3 * frame_cnt; i++) {
+		struct frame *frame = clock_advance ();
+
+		victims_scanned++;
+		if (frame->pin_cnt > 0 || frame->page == NULL
+				|| (owner != NULL && frame->page->owner != owner)
+				|| (frame_is_shared (frame) && frame->seg_inode == NULL
+					&& page_get_type (frame->page) != VM_SHM
+					&& (page_get_type (frame->page) != VM_ANON
+						|| list_size (&frame->pages) > EVICT_CLUSTER)))
+			continue;
+		if (frame_test_and_clear_accessed (frame))
+			continue;
+		if (i < frame_cnt && frame_is_dirty (frame))
+			continue;
+		return frame;
+	}
+	return NULL;
+}
+
+/* Removes FRAME, which no page uses any more, from the frame table and
+ * frees it.  Must be called with frame_lock held. */
+static void
+frame_release (struct frame *frame) {
+	ASSERT (frame->page == NULL);
+
+	if (frame->seg_inode != NULL)
+		hash_delete (&seg_cache, &frame->seg_elem);
+	if (frame->ksm)
+		ksm_forget (frame);
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	list_remove (&frame->elem);
+	palloc_free_page (frame->kva);
+	free (frame);
+}
+
+/* Stores VICTIM's page into PAGES, followed by the anonymous pages in
+ * the frames right after it that the CLOCK would evict next, so that
+ * they can go to swap together.  Returns the number of pages stored.
+ * Must be called with frame_lock held. */
+static size_t
+gather_cluster (struct frame *victim, struct page *pages[]) {
+	size_t cnt = 0;
+
+	pages[cnt++] = victim->page;
+	while (cnt < EVICT_CLUSTER && clock_hand != list_end (&frame_table)) {
+		struct frame *frame = list_entry (clock_hand, struct frame, elem);
+		struct page *page = frame->page;
+
+		if (frame->pin_cnt > 0 || page == NULL || frame_is_shared (frame)
+				|| page_get_type (page) != VM_ANON
+				|| pml4_is_accessed (page->owner->pml4, page->va))
+			break;
+		clock_hand = list_next (clock_hand);
+		victims_scanned++;
+		pages[cnt++] = page;
+	}
+	return cnt;
+}
+
+/* Stores the pages that share VICTIM, at most EVICT_CLUSTER of them,
+ * into PAGES.  Returns the number of pages stored.  Must be called with
+ * frame_lock held. */
+static size_t
+gather_sharers (struct frame *victim, struct page *pages[]) {
+	struct list_elem *e;
+	size_t cnt = 0;
+
+	for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+			e = list_next (e)) {
+		ASSERT (cnt < EVICT_CLUSTER);
+		pages[cnt++] = list_entry (e, struct page, frame_elem);
+	}
+	return cnt;
+}
+
+/* Evicts VICTIM, which holds an anonymous page, together with the
+ * pages gather_cluster() finds after it.  The other evicted frames are
+ * freed.  If VICTIM is shared copy-on-write, every sharer is evicted
+ * instead, each to a swap slot of its own, and no other frame.  A page
+ * that cannot be evicted is mapped again, writable only if it no longer
+ * shares its frame and the frame is not merged, whose pages must keep
+ * faulting on writes.
+ *
+ * The write to swap runs with frame_lock released.  The frames stay
+ * pinned and marked EVICTING meanwhile, so that other evictions and the
+ * same-page scanner pass them over, and threads that would map, copy or
+ * free their pages wait.
+ * Returns true if VICTIM was evicted.  Must be called with frame_lock
+ * held. */
+static bool
+evict_anon (struct frame *victim) {
+	struct page *pages[EVICT_CLUSTER];
+	size_t cnt = frame_is_shared (victim) ? gather_sharers (victim, pages)
+		: gather_cluster (victim, pages);
+	size_t done, i;
+
+	/* Unmap first, so the owners cannot modify the pages behind the
+	 * write.  Sharers visit their frame once. */
+	for (i = 0; i < cnt; i++) {
+		struct frame *frame = pages[i]->frame;
+
+		pml4_clear_page (pages[i]->owner->pml4, pages[i]->va);
+		if (!frame->evicting) {
+			frame->evicting = true;
+			frame->pin_cnt++;
+			if (frame->ksm)
+				ksm_forget (frame);
+		}
+	}
+	lock_release (&frame_lock);
+	done = anon_swap_out_cluster (pages, cnt);
+	lock_acquire (&frame_lock);
+
+	for (i = 0; i < cnt; i++) {
+		struct page *page = pages[i];
+		struct frame *frame = page->frame;
+
+		if (frame->evicting) {
+			frame->evicting = false;
+			frame->pin_cnt--;
+		}
+		if (i >= done) {
+			pml4_set_page (page->owner->pml4, page->va, frame->kva,
+					page->writable && !frame_is_shared (frame) && !frame->ksm);
+			continue;
+		}
+		frame_unlink (page);
+		if (frame != victim)
+			frame_release (frame);
+	}
+	cond_broadcast (&evict_done, &frame_lock);
+	dirty_evict_cnt += done;
+	return victim->page == NULL;
+}
+
+/* Evicts VICTIM, a frame of the segment cache, by unmapping it from
+ * every process that shares it.  The file still holds the contents, so
+ * nothing is written.  Must be called with frame_lock held. */
+static void
+evict_segment (struct frame *victim) {
+	while (victim->page != NULL) {
+		struct page *page = victim->page;
+
+		pml4_clear_page (page->owner->pml4, page->va);
+		frame_unlink (page);
+	}
+	hash_delete (&seg_cache, &victim->seg_elem);
+	victim->seg_inode = NULL;
+	clean_evict_cnt++;
+	seg_drop_cnt++;
+}
+
+/* Evicts VICTIM, a shared memory frame, by swapping out the master page
+ * and unmapping it from every process that maps it.  Returns true if
+ * successful.  Must be called with frame_lock held. */
+static bool
+evict_shared (struct frame *victim) {
+	struct page *master = shm_master (victim->page);
+	struct list_elem *e;
+
+	ASSERT (master->frame == victim);
+
+	/* Unmap first, so that no process modifies the page behind the
+	 * write. */
+	for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+
+		pml4_clear_page (page->owner->pml4, page->va);
+	}
+	if (anon_swap_out_cluster (&master, 1) == 0) {
+		for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+				e = list_next (e)) {
+			struct page *page = list_entry (e, struct page, frame_elem);
+
+			pml4_set_page (page->owner->pml4, page->va, victim->kva,
+					page->writable);
+		}
+		return false;
+	}
+	while (victim->page != NULL)
+		frame_unlink (victim->page);
+	master->frame = NULL;
+	dirty_evict_cnt++;
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Evicts VICTIM, which holds a file-backed page, writing it back if it
+ * is dirty.  Returns true if successful.  Must be called with frame_lock
+ * held. */
+static bool
+evict_file (struct frame *victim) {
+	struct page *page = victim->page;
+	uint64_t *pml4 = page->owner->pml4;
+	bool dirty = frame_is_dirty (victim);
+	bool success;
+
+	if (victim->seg_inode != NULL) {
+		evict_segment (victim);
+		return true;
+	}
+
+	/* Unmap first, so the owner cannot modify the page behind the
+	 * writeback.  The dirty bit survives the unmapping.  The writeback
+	 * may wait for file system locks with frame_lock held, which is
+	 * safe because no thread faults while it holds one: system calls
+	 * copy user memory outside the file system. */
+	pml4_clear_page (pml4, page->va);
+	success = swap_out (page);
+
+	if (!success) {
+		pml4_set_page (pml4, page->va, victim->kva,
+				page->writable && dirty);
+		pml4_set_dirty (pml4, page->va, dirty);
+		return false;
+	}
+	if (dirty)
+		dirty_evict_cnt++;
+	else
+		clean_evict_cnt++;
+	frame_unlink (page);
+	return true;
+}
+
+/* Evict one page and return the corresponding frame.
+ * Return NULL on error.
+ *
+ * If OWNER is not null, only OWNER's own pages are considered. */
 static struct frame *
-vm_get_victim (void) {
+vm_evict_frame (struct thread *owner) {
 	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+	size_t tries;
+
+	lock_acquire (&frame_lock);
+	for (tries = list_size (&frame_table); tries > 0; tries--) {
+		bool evicted;
 
+		victim = vm_get_victim (owner);
+		if (victim == NULL)
+			break;
+		if (page_get_type (victim->page) == VM_ANON)
+			evicted = evict_anon (victim);
+		else if (page_get_type (victim->page) == VM_SHM)
+			evicted = evict_shared (victim);
+		else
+			evicted = evict_file (victim);
+		if (evicted) {
+			if (victim->ksm)
+				ksm_forget (victim);
+			victim->pin_cnt = 1;
+			break;
+		}
+		/* This page cannot be evicted now; move on. */
+		victim = NULL;
+	}
+	lock_release (&frame_lock);
 	return victim;
 }
 
-/* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+/* Adds a pinned frame for the user pool page KVA to the frame table.
+ * Returns the frame, or a null pointer if memory runs out. */
 static struct frame *
-vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+frame_new (void *kva) {
+	struct frame *frame = malloc (sizeof *frame);
 
-	return NULL;
+	if (frame == NULL)
+		return NULL;
+	frame->kva = kva;
+	frame->page = NULL;
+	list_init (&frame->pages);
+	frame->pin_cnt = 1;
+	frame->evicting = false;
+	frame->seg_inode = NULL;
+	frame->ksm = false;
+	lock_acquire (&frame_lock);
+	list_push_back (&frame_table, &frame->elem);
+	lock_release (&frame_lock);
+	return frame;
+}
+
+/* Returns true if T has as many resident frames as memlimit() allows
+ * it, or more. */
+static bool
+over_rss_limit (struct thread *t) {
+	return t->rss_limit != 0 && t->rss_cnt >= t->rss_limit;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space.
+ *
+ * If nothing can be evicted either, the OOM killer frees memory by killing
+ * a process.  If that is the current one, returns a null pointer, and
+ * the caller releases what it holds and fails the fault, so that the
+ * process exits in page_fault().  The frame comes back pinned;
+ * vm_do_claim_page() unpins it once the page is mapped. */
 static struct frame *
 vm_get_frame (void) {
+	struct thread *curr = thread_current ();
 	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
 
-	ASSERT (frame != NULL);
+	/* A process at its memory limit gives up a frame of its own. */
+	if (over_rss_limit (curr)) {
+		frame = vm_evict_frame (curr);
+		if (frame != NULL)
+			limit_evict_cnt++;
+	}
+	while (frame == NULL) {
+		void *kva;
+
+		if (curr->oom_killed)
+			return NULL;
+		kva = palloc_get_page (PAL_USER);
+		if (kva != NULL) {
+			/* Without kernel memory for a new frame, reuse an old one. */
+			frame = frame_new (kva);
+			if (frame == NULL)
+				palloc_free_page (kva);
+		}
+		if (frame == NULL)
+			frame = vm_evict_frame (NULL);
+		if (frame == NULL)
+			oom_kill ();
+	}
+	oom_check_watermark ();
+
 	ASSERT (frame->page == NULL);
 	return frame;
 }
 
+/* Evicts a frame and returns it to the user pool.  Returns false if no
+ * frame can be evicted.  Used by background reclaim. */
+bool
+vm_reclaim_frame (void) {
+	struct frame *frame = vm_evict_frame (NULL);
+
+	if (frame == NULL)
+		return false;
+	lock_acquire (&frame_lock);
+	frame_release (frame);
+	lock_release (&frame_lock);
+	return true;
+}
+
+/* Unmaps PAGE and drops its share of its frame, if it has one.  The
+ * frame is released with its last page. */
+void
+vm_free_frame (struct page *page) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	frame_wait_evict (page);
+	frame = page->frame;
+	if (frame != NULL) {
+		pml4_clear_page (page->owner->pml4, page->va);
+		if (frame_unlink (page) && frame != &zero_frame)
+			frame_release (frame);
+	}
+	lock_release (&frame_lock);
+}
+
+/* Unmaps PAGE, a shared memory page, and drops its share of its frame,
+ * which is released with its last page.  With KEEP, the contents outlive
+ * the frame: the master page is swapped out first, so that an object no
+ * process maps holds no memory.  Only if that fails, because the swap
+ * disk is full, does the frame stay with the master page until another
+ * process maps it. */
+void
+vm_free_shared_frame (struct page *page, bool keep) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	frame = page->frame;
+	if (frame != NULL) {
+		pml4_clear_page (page->owner->pml4, page->va);
+		if (frame_unlink (page)) {
+			struct page *master = shm_master (page);
+
+			if (!keep || anon_swap_out_cluster (&master, 1) == 1) {
+				master->frame = NULL;
+				frame_release (frame);
+			}
+		}
+	}
+	lock_release (&frame_lock);
+}
+
+/* Releases the frame that MASTER, the master page of a shared memory
+ * object no process maps any more, still holds. */
+void
+vm_free_master_frame (struct page *master) {
+	lock_acquire (&frame_lock);
+	if (master->frame != NULL) {
+		frame_release (master->frame);
+		master->frame = NULL;
+	}
+	lock_release (&frame_lock);
+}
+
+/* Keeps PAGE's frame from being evicted until vm_unpin_page().  Returns
+ * false, pinning nothing, if PAGE is not resident. */
+bool
+vm_pin_page (struct page *page) {
+	bool resident;
+
+	lock_acquire (&frame_lock);
+	frame_wait_evict (page);
+	resident = page->frame != NULL;
+	if (resident)
+		page->frame->pin_cnt++;
+	lock_release (&frame_lock);
+	return resident;
+}
+
+/* Makes PAGE's frame evictable again. */
+void
+vm_unpin_page (struct page *page) {
+	lock_acquire (&frame_lock);
+	if (page->frame != NULL && page->frame->pin_cnt > 0)
+		page->frame->pin_cnt--;
+	lock_release (&frame_lock);
+}
+
 /* Growing the stack. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+vm_stack_growth (void *addr) {
+	vm_alloc_page (VM_ANON | VM_STACK, pg_round_down (addr), true);
 }
 
-/* Handle the fault on write_protected page */
+/* Returns true if PAGE is an initialized executable segment page. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+is_segment_page (struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_FILE && page->file.segment;
+}
+
+/* Marks PAGE, about to be mapped writable, as modified. */
+static void
+mark_written (struct page *page) {
+	if (is_segment_page (page))
+		anon_adopt (page);
+	else if (page_get_type (page) == VM_FILE)
+		file_set_dirty (page);
+}
+
+/* Handle the fault on write_protected page
+ *
+ * PAGE is writable but maps the zero frame, shares its frame
+ * copy-on-write, it is a data
+ * segment page still holding the file's contents, or it is a mapped page
+ * written for the first time since its last writeback.  The last page
+ * left on a frame takes it over; any other gets a private copy.  A
+ * segment page becomes anonymous, since its contents no longer match the
+ * file; a mapped page becomes dirty, and its writer may have to wait for
+ * the flusher.  Returns false if no frame can be had for the copy. */
+static bool
+vm_handle_wp (struct page *page) {
+	struct frame *old, *new;
+
+	lock_acquire (&frame_lock);
+	frame_wait_evict (page);
+	old = page->frame;
+	if (old == NULL) {
+		/* Evicted since the fault; retrying faults it back in. */
+		lock_release (&frame_lock);
+		return true;
+	}
+	if (old->ksm)
+		ksm_note_split ();
+	if (!frame_is_shared (old) && old != &zero_frame) {
+		if (is_segment_page (page) && old->seg_inode != NULL) {
+			hash_delete (&seg_cache, &old->seg_elem);
+			old->seg_inode = NULL;
+		}
+		if (old->ksm)
+			ksm_forget (old);
+		mark_written (page);
+		remap_page (page, old->kva, true);
+		lock_release (&frame_lock);
+		file_throttle_dirty ();
+		return true;
+	}
+	old->pin_cnt++;
+	lock_release (&frame_lock);
+
+	/* Without a frame the fault fails, leaving OLD unpinned. */
+	new = vm_get_frame ();
+	if (new != NULL)
+		memcpy (new->kva, old->kva, PGSIZE);
+
+	lock_acquire (&frame_lock);
+	old->pin_cnt--;
+	if (new == NULL) {
+		lock_release (&frame_lock);
+		return false;
+	}
+	/* The other sharers may have gone while frame_lock was dropped. */
+	if (frame_unlink (page) && old != &zero_frame)
+		frame_release (old);
+	frame_link (new, page);
+	mark_written (page);
+	remap_page (page, new->kva, true);
+	new->pin_cnt--;
+	if (old == &zero_frame)
+		zero_copy_cnt++;
+	else
+		cow_copy_cnt++;
+	lock_release (&frame_lock);
+	file_throttle_dirty ();
+	return true;
+}
+
+/* Maps PAGE read-only to the zero frame for a read fault, if PAGE is an
+ * anonymous page that holds nothing but zeros: one never touched and
+ * without a loader, or one evicted while all zero.  Returns true if
+ * successful.  The first write copies the zero frame in vm_handle_wp(),
+ * so zero pages take no frame of their own and never reach swap. */
+static bool
+map_zero_page (struct page *page) {
+	/* An eviction in progress may still give PAGE the zero flag. */
+	lock_acquire (&frame_lock);
+	frame_wait_evict (page);
+	lock_release (&frame_lock);
+
+	if (VM_TYPE (page->operations->type) == VM_UNINIT) {
+		if (VM_TYPE (page->uninit.type) != VM_ANON
+				|| page->uninit.init != NULL)
+			return false;
+		/* Zeros, like an evicted zero page, until mapped. */
+		anon_adopt (page);
+		page->anon.zero = true;
+	} else if (page_get_type (page) != VM_ANON || !anon_is_zero (page))
+		return false;
+
+	/* The flag stays set until the mapping is in place, so that a
+	 * failure leaves PAGE reading back as zeros. */
+	lock_acquire (&frame_lock);
+	frame_link (&zero_frame, page);
+	lock_release (&frame_lock);
+	if (!pml4_set_page (page->owner->pml4, page->va, zero_frame.kva, false)) {
+		vm_free_frame (page);
+		return false;
+	}
+	anon_clear_zero (page);
+	zero_map_cnt++;
+	return true;
+}
+
+/* Returns true if a fault at ADDR, with the user stack pointer at RSP,
+ * should grow the stack. */
+static bool
+is_stack_access (struct supplemental_page_table *spt, void *addr, void *rsp) {
+	struct vm_region *region = spt_find_region (spt, addr);
+
+	/* PUSH faults 8 bytes below the stack pointer. */
+	return region != NULL && region->kind == REGION_STACK
+		&& (uint8_t *) addr >= (uint8_t *) rsp - 8;
+}
+
+/* Returns true if claiming PAGE has to read it from a file or the swap
+ * disk, which makes a fault on it a major one. */
+static bool
+claim_needs_io (struct page *page) {
+	struct frame key;
+	bool cached;
+
+	if (page_get_type (page) == VM_SHM) {
+		page = shm_master (page);
+		if (page->frame != NULL)
+			return false;
+	}
+	if (file_segment_pos (page, &key.seg_inode, &key.seg_ofs,
+				&key.seg_bytes)) {
+		lock_acquire (&frame_lock);
+		cached = hash_find (&seg_cache, &key.seg_elem) != NULL;
+		lock_release (&frame_lock);
+		return !cached;
+	}
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_UNINIT:
+			/* Anonymous memory without a loader is zero-filled. */
+			return page->uninit.init != NULL;
+		case VM_ANON:
+			return page->anon.slot != BITMAP_ERROR;
+		default:
+			return true;
+	}
+}
+
+/* Resolves a fault, as vm_try_handle_fault(), and stores its kind in
+ * *TYPE if successful. */
+static bool
+handle_fault (struct intr_frame *f, void *addr, bool user, bool write,
+		bool not_present, enum vm_fault_type *type) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page = NULL;
+	bool success;
+
+	/* Validate the fault */
+	if (addr == NULL || is_kernel_vaddr (addr))
+		return false;
+
+	/* A process chosen by the OOM killer exits here. */
+	if (thread_current ()->oom_killed)
+		return false;
+
+	page = spt_find_page (spt, addr);
+	if (!not_present) {
+		*type = VM_FAULT_COW;
+		return write && page != NULL && page->writable
+			&& vm_handle_wp (page);
+	}
+
+	if (page == NULL) {
+		/* Faults inside a system call see the kernel's rsp, so use the
+		 * one saved on entry. */
+		void *rsp = user ? (void *) f->rsp : thread_current ()->user_rsp;
+
+		if (!is_stack_access (spt, addr, rsp))
+			return false;
+		vm_stack_growth (addr);
+		page = spt_find_page (spt, addr);
+		if (page == NULL)
+			return false;
+		*type = VM_FAULT_STACK;
+	} else
+		*type = claim_needs_io (page) ? VM_FAULT_MAJOR : VM_FAULT_MINOR;
+	if (write && !page->writable)
+		return false;
+
+	if (!write && map_zero_page (page)) {
+		if (*type != VM_FAULT_STACK)
+			*type = VM_FAULT_ZERO;
+		success = true;
+	} else
+		success = vm_do_claim_page (page);
+	if (success)
+		fault_around (spt, page);
+	return success;
+}
+
+/* Returns the latency histogram bucket for a fault that took CYCLES. */
+static unsigned
+fault_bucket (uint64_t cycles) {
+	unsigned bucket = 0;
+
+	while (cycles > 1 && bucket < FAULT_HIST_BUCKETS - 1) {
+		cycles >>= 1;
+		bucket++;
+	}
+	return bucket;
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
-	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct fault_stats *stats = &thread_current ()->fault_stats;
+	enum vm_fault_type type = VM_FAULT_INVALID;
+	uint64_t start = rdtsc ();
+	bool success = handle_fault (f, addr, user, write, not_present, &type);
+	uint64_t cycles = rdtsc () - start;
+	unsigned bucket = fault_bucket (cycles);
 
-	return vm_do_claim_page (page);
+	if (!success)
+		type = VM_FAULT_INVALID;
+	else {
+		fault_cnt++;
+		fault_cycles += cycles;
+	}
+	stats->cnt[type]++;
+	stats->hist[bucket]++;
+	fault_type_cnt[type]++;
+	fault_hist[type][bucket]++;
+	return success;
+}
+
+/* Returns a fault statistic of the current process, or of the whole
+ * system if SYSTEM: the number of faults of type IDX, or if LATENCY the
+ * number of faults in latency bucket IDX.  Returns 0 if IDX is out of
+ * range. */
+uint64_t
+vm_fault_stat (bool system, bool latency, unsigned idx) {
+	struct fault_stats *stats = &thread_current ()->fault_stats;
+	uint64_t cnt = 0;
+	unsigned type;
+
+	if (!latency) {
+		if (idx < VM_FAULT_TYPE_CNT)
+			cnt = system ? fault_type_cnt[idx] : stats->cnt[idx];
+	} else if (idx < FAULT_HIST_BUCKETS) {
+		if (!system)
+			cnt = stats->hist[idx];
+		else
+			for (type = 0; type < VM_FAULT_TYPE_CNT; type++)
+				cnt += fault_hist[type][idx];
+	}
+	return cnt;
+}
+
+/* Formats the non-empty buckets of latency histogram HIST into BUF, as
+ * "log2 of cycles:faults" pairs. */
+static void
+format_hist (char *buf, size_t size, const uint64_t hist[]) {
+	size_t len = 0;
+	unsigned i;
+
+	buf[0] = '\0';
+	for (i = 0; i < FAULT_HIST_BUCKETS && len < size; i++)
+		if (hist[i] != 0)
+			len += snprintf (buf + len, size - len, " %u:%llu", i, hist[i]);
+}
+
+/* Prints the fault statistics of the current process. */
+void
+vm_print_fault_stats (void) {
+	struct thread *curr = thread_current ();
+	struct fault_stats *stats = &curr->fault_stats;
+	uint64_t hist[FAULT_HIST_BUCKETS];
+	char buf[256];
+	unsigned i;
+
+	for (i = 0; i < FAULT_HIST_BUCKETS; i++)
+		hist[i] = stats->hist[i];
+	format_hist (buf, sizeof buf, hist);
+	printf ("%s: faults: %u minor, %u major, %u zero, %u cow, %u stack, "
+			"%u invalid\n", curr->name, stats->cnt[VM_FAULT_MINOR],
+			stats->cnt[VM_FAULT_MAJOR], stats->cnt[VM_FAULT_ZERO],
+			stats->cnt[VM_FAULT_COW], stats->cnt[VM_FAULT_STACK],
+			stats->cnt[VM_FAULT_INVALID]);
+	printf ("%s: fault latency (log2 cycles):%s\n", curr->name, buf);
 }
 
 /* Free the page.
@@ -150,41 +1232,667 @@ vm_dealloc_page (struct page *page) {
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
 
+	if (page == NULL)
+		return false;
 	return vm_do_claim_page (page);
 }
 
+/* Maps PAGE to the cached frame that holds READ_BYTES bytes of INODE
+ * at OFS, if there is one.  Returns true if successful. */
+static bool
+share_segment (struct page *page, struct inode *inode, off_t ofs,
+		size_t read_bytes) {
+	struct frame key;
+	struct hash_elem *e;
+	bool success = false;
+
+	key.seg_inode = inode;
+	key.seg_ofs = ofs;
+	key.seg_bytes = read_bytes;
+
+	lock_acquire (&frame_lock);
+	e = hash_find (&seg_cache, &key.seg_elem);
+	if (e != NULL) {
+		struct frame *frame = hash_entry (e, struct frame, seg_elem);
+
+		/* The contents are already there, so a page that was never
+		 * loaded is only set up. */
+		if ((VM_TYPE (page->operations->type) != VM_UNINIT
+					|| page->uninit.page_initializer (page, page->uninit.type,
+						frame->kva))
+				&& pml4_set_page (page->owner->pml4, page->va, frame->kva,
+					false)) {
+			frame_link (frame, page);
+			seg_share_cnt++;
+			success = true;
+		}
+	}
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Fills FRAME, a pinned frame without a page, with PAGE's contents and
+ * maps it.  A segment frame is offered to the segment cache.  Gives
+ * FRAME back if PAGE turns out to be resident already.  Returns true if
+ * PAGE is resident, false if it could not be loaded or FRAME is null
+ * because vm_get_frame() found none. */
+static bool
+load_page (struct page *page, struct frame *frame) {
+	struct inode *inode;
+	off_t ofs;
+	size_t read_bytes;
+	bool segment;
+
+	if (frame == NULL)
+		return false;
+	segment = file_segment_pos (page, &inode, &ofs, &read_bytes);
+
+	/* Set links */
+	lock_acquire (&frame_lock);
+	frame_wait_evict (page);
+	if (page->frame != NULL) {
+		frame_release (frame);
+		lock_release (&frame_lock);
+		return true;
+	}
+	frame_link (frame, page);
+	lock_release (&frame_lock);
+
+	/* Fill the frame before the user can see it, then map it.  File
+	 * pages stay read-only: a write to a segment page copies it, and a
+	 * write to a mapped page marks it dirty. */
+	if (!swap_in (page, frame->kva)
+			|| !pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable && page_get_type (page) != VM_FILE)) {
+		vm_free_frame (page);
+		return false;
+	}
+
+	if (segment) {
+		/* Offer the frame to other processes running the program.  If
+		 * one loaded the same page meanwhile, keep this copy private. */
+		lock_acquire (&frame_lock);
+		frame->seg_inode = inode;
+		frame->seg_ofs = ofs;
+		frame->seg_bytes = read_bytes;
+		if (hash_insert (&seg_cache, &frame->seg_elem) != NULL)
+			frame->seg_inode = NULL;
+		seg_load_cnt++;
+		lock_release (&frame_lock);
+	} else if (page_get_type (page) == VM_SHM) {
+		/* Other processes that map the page find the frame here. */
+		lock_acquire (&frame_lock);
+		shm_master (page)->frame = frame;
+		lock_release (&frame_lock);
+	}
+	vm_unpin_page (page);
+	return true;
+}
+
+/* Maps PAGE to a frame from the segment cache if it is a segment page
+ * whose contents another process already loaded.  Returns true if
+ * successful. */
+static bool
+share_cached (struct page *page) {
+	struct inode *inode;
+	off_t ofs;
+	size_t read_bytes;
+
+	return file_segment_pos (page, &inode, &ofs, &read_bytes)
+		&& share_segment (page, inode, ofs, read_bytes);
+}
+
+/* Claims PAGE, a shared memory page.  The pages of all processes for
+ * the same page of the object map one frame: the first process to fault
+ * loads it from the master page, and the others link to it. */
+static bool
+load_shared (struct page *page) {
+	size_t idx;
+	struct shm_object *obj = shm_locate (page, &idx);
+	struct frame *frame;
+	bool linked = false, success = true;
+
+	lock_acquire (&obj->lock);
+	lock_acquire (&frame_lock);
+	frame = obj->pages[idx]->frame;
+	if (frame != NULL && page->frame == NULL) {
+		if (VM_TYPE (page->operations->type) == VM_UNINIT)
+			shm_initializer (page, page->uninit.type, frame->kva);
+		frame_link (frame, page);
+		frame->pin_cnt++;
+		linked = true;
+	}
+	lock_release (&frame_lock);
+
+	if (frame == NULL)
+		success = load_page (page, vm_get_frame ());
+	else if (linked) {
+		success = pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable);
+		lock_acquire (&frame_lock);
+		if (!success)
+			frame_unlink (page);
+		frame->pin_cnt--;
+		lock_release (&frame_lock);
+	}
+	lock_release (&obj->lock);
+	return success;
+}
+
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	/* Pages that already left the uninit state were evicted before. */
+	if (VM_TYPE (page->operations->type) != VM_UNINIT)
+		refault_cnt++;
 
-	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	if (page_get_type (page) == VM_SHM)
+		return load_shared (page);
+	if (share_cached (page))
+		return true;
+	return load_page (page, vm_get_frame ());
+}
+
+/* Brings PAGE in ahead of an access, but only into a free frame: read-
+ * ahead never evicts.  Returns true if PAGE is now resident. */
+bool
+vm_prefetch_page (struct page *page) {
+	void *kva;
+	struct frame *frame;
+
+	if (share_cached (page))
+		return true;
+	if (over_rss_limit (thread_current ()))
+		return false;
+	kva = palloc_get_page (PAL_USER);
+	if (kva == NULL)
+		return false;
+	frame = frame_new (kva);
+	if (frame == NULL) {
+		palloc_free_page (kva);
+		return false;
+	}
+	oom_check_watermark ();
+	return load_page (page, frame);
+}
+
+/* Calls FUNC on each frame with frame_lock held, passing AUX along,
+ * until FUNC returns false.  FUNC may release the frame it is given. */
+void
+vm_for_each_frame (bool (*func) (struct frame *, void *), void *aux) {
+	struct list_elem *e, *next;
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+	lock_acquire (&frame_lock);
+	for (e = list_begin (&frame_table); e != list_end (&frame_table);
+			e = next) {
+		next = list_next (e);
+		if (!func (list_entry (e, struct frame, elem), aux))
+			break;
+	}
+	lock_release (&frame_lock);
+}
+
+/* Returns true if FRAME holds anonymous memory that the same-page
+ * scanner may merge.  Must be called with frame_lock held. */
+bool
+vm_frame_is_mergeable (struct frame *frame) {
+	struct list_elem *e;
 
-	return swap_in (page, frame->kva);
+	if (frame->pin_cnt > 0 || frame->page == NULL)
+		return false;
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e))
+		if (page_get_type (list_entry (e, struct page, frame_elem))
+				!= VM_ANON)
+			return false;
+	return true;
+}
+
+/* Maps every page of FRAME read-only, so that its contents stay put
+ * until a write fault.  Must be called with frame_lock held. */
+void
+vm_protect_frame (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e))
+		remap_page (list_entry (e, struct page, frame_elem), frame->kva,
+				false);
+}
+
+/* Moves the pages of DUP, a protected frame with the same contents as
+ * INTO, to INTO, or to the zero frame if INTO is null, and releases DUP.
+ * The first write to a page copies it again in vm_handle_wp().  Must be
+ * called with frame_lock held. */
+void
+vm_merge_frame (struct frame *dup, struct frame *into) {
+	if (into == NULL)
+		into = &zero_frame;
+	while (dup->page != NULL) {
+		struct page *page = dup->page;
+
+		remap_page (page, into->kva, false);
+		frame_unlink (page);
+		frame_link (into, page);
+	}
+	frame_release (dup);
+}
+
+/* Returns true if PAGE, resident or not, is backed by a file. */
+static bool
+is_file_page (struct page *page) {
+	return page_get_type (page) == VM_FILE;
+}
+
+/* Lets the CLOCK take the page RA_MAX pages before VA in REGION, a
+ * region read sequentially, ahead of others: the scan will not come back
+ * to it. */
+static void
+drop_behind (struct supplemental_page_table *spt, struct vm_region *region,
+		void *va) {
+	uint8_t *behind = (uint8_t *) va - RA_MAX * PGSIZE;
+	struct page *page;
+
+	if (behind < (uint8_t *) region->start
+			|| (page = spt_find_page (spt, behind)) == NULL)
+		return;
+
+	lock_acquire (&frame_lock);
+	if (page->frame != NULL && !frame_is_shared (page->frame)) {
+		pml4_set_accessed (page->owner->pml4, page->va, false);
+		drop_behind_cnt++;
+	}
+	lock_release (&frame_lock);
+}
+
+/* Called after PAGE, a page of SPT, faulted in.
+ *
+ * Fault-around maps the segment pages in the aligned block around PAGE
+ * whose frames the segment cache already holds, which costs no I/O.
+ * Read-ahead then loads the file pages after PAGE, which lie in the same
+ * run on disk.  The window opens once RA_RUN faults in a region have
+ * been sequential, grows while they stay so, and collapses on a random
+ * access.  madvise() can fix the
+ * window at its largest, or turn both off. */
+static void
+fault_around (struct supplemental_page_table *spt, struct page *page) {
+	struct vm_region *region = spt_find_region (spt, page->va);
+	uint8_t *start, *end, *va;
+
+	if (region == NULL || region->file == NULL || !is_file_page (page)
+			|| region->advice == VM_ADV_RANDOM)
+		return;
+
+	start = (uint8_t *) page->va
+		- (pg_no (page->va) % FAULT_AROUND) * PGSIZE;
+	end = start + FAULT_AROUND * PGSIZE;
+	if (start < (uint8_t *) region->start)
+		start = region->start;
+	if (end > (uint8_t *) region->end)
+		end = region->end;
+	for (va = start; va < end; va += PGSIZE) {
+		struct page *p = spt_find_page (spt, va);
+
+		if (p != NULL && p->frame == NULL && share_cached (p))
+			around_cnt++;
+	}
+
+	if (region->advice == VM_ADV_SEQUENTIAL) {
+		region->ra_window = RA_MAX;
+		drop_behind (spt, region, page->va);
+	} else if (page->va != region->ra_next) {
+		region->ra_run = 0;
+		region->ra_window = 0;
+	} else if (++region->ra_run >= RA_RUN) {
+		if (region->ra_window < RA_MIN)
+			region->ra_window = RA_MIN;
+		else if (region->ra_window < RA_MAX)
+			region->ra_window *= 2;
+	}
+
+	for (va = (uint8_t *) page->va + PGSIZE;
+			va < (uint8_t *) page->va + (region->ra_window + 1) * PGSIZE
+			&& va < (uint8_t *) region->end; va += PGSIZE) {
+		struct page *p = spt_find_page (spt, va);
+
+		if (p == NULL || p->frame != NULL)
+			continue;
+		if (!is_file_page (p) || !vm_prefetch_page (p))
+			break;
+		readahead_cnt++;
+	}
+	region->ra_next = va;
+}
+
+/* Brings PAGE in for madvise(WILLNEED), if it has contents to load:
+ * untouched anonymous pages would only be zeroed, and shared memory
+ * pages come in through their own faults. */
+static void
+willneed_page (struct page *page) {
+	if (page->frame != NULL || page_get_type (page) == VM_SHM
+			|| (VM_TYPE (page->operations->type) == VM_UNINIT
+				&& page_get_type (page) == VM_ANON))
+		return;
+	if (vm_prefetch_page (page))
+		willneed_cnt++;
+}
+
+/* Releases the memory of PAGE, a page of REGION in SPT, for
+ * madvise(DONTNEED).  Anonymous pages lose their frame and swap slot and
+ * read back as zeros; mapped file pages are written back if dirty and
+ * read back from the file.  Shared memory pages are only unmapped, since
+ * other processes may still use them.  Segment pages are left alone:
+ * their private copies cannot be rebuilt from the region.  The fresh
+ * page is made before PAGE goes, so that running out of memory leaves
+ * PAGE as it was. */
+static void
+dontneed_page (struct supplemental_page_table *spt, struct vm_region *region,
+		struct page *page) {
+	enum vm_type type = page_get_type (page);
+	bool writable = page->writable;
+	void *va = page->va;
+	struct page *fresh;
+
+	if (region->kind == REGION_SEGMENT
+			|| VM_TYPE (page->operations->type) == VM_UNINIT)
+		return;
+
+	if (type == VM_SHM) {
+		if (page->frame != NULL) {
+			shm_release (page);
+			dontneed_cnt++;
+		}
+		return;
+	}
+
+	if (type == VM_FILE) {
+		struct lazy_load_info *info = malloc (sizeof *info);
+
+		if (info == NULL)
+			return;
+		info->file = page->file.file;
+		info->ofs = page->file.ofs;
+		info->read_bytes = page->file.read_bytes;
+		info->zero_bytes = PGSIZE - info->read_bytes;
+		fresh = page_new (VM_FILE, va, writable, file_lazy_load, info);
+		if (fresh == NULL) {
+			free (info);
+			return;
+		}
+	} else {
+		fresh = page_new (region->kind == REGION_STACK ? VM_ANON | VM_STACK
+				: VM_ANON, va, writable, NULL, NULL);
+		if (fresh == NULL)
+			return;
+	}
+	spt_remove_page (spt, page);
+	spt_insert_page (spt, fresh);
+	dontneed_cnt++;
+}
+
+/* Applies ADVICE to the LENGTH bytes at ADDR, a page-aligned range of
+ * the current process.  An access pattern applies to every region the
+ * range touches, as regions are not split.  Returns false if part of the
+ * range is not mapped. */
+bool
+vm_madvise (void *addr, size_t length, enum vm_advice advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *end = pg_round_up ((uint8_t *) addr + length);
+	uint8_t *va = addr;
+
+	while (va < end) {
+		struct vm_region *region = spt_find_region (spt, va);
+		uint8_t *stop;
+
+		if (region == NULL)
+			return false;
+		stop = end < (uint8_t *) region->end ? end : region->end;
+
+		if (advice == VM_ADV_WILLNEED || advice == VM_ADV_DONTNEED) {
+			for (; va < stop; va += PGSIZE) {
+				struct page *page = spt_find_page (spt, va);
+
+				if (page == NULL)
+					continue;
+				if (advice == VM_ADV_WILLNEED)
+					willneed_page (page);
+				else
+					dontneed_page (spt, region, page);
+			}
+		} else {
+			region->advice = advice;
+			region->ra_run = 0;
+			region->ra_window = 0;
+			va = stop;
+		}
+	}
+	return true;
+}
+
+/* Hashes a segment cache frame by file position. */
+static uint64_t
+seg_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct frame *f = hash_entry (e, struct frame, seg_elem);
+	return hash_bytes (&f->seg_inode, sizeof f->seg_inode)
+		^ hash_int (f->seg_ofs) ^ hash_int (f->seg_bytes);
+}
+
+/* Orders segment cache frames by file position. */
+static bool
+seg_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct frame *a = hash_entry (a_, struct frame, seg_elem);
+	const struct frame *b = hash_entry (b_, struct frame, seg_elem);
+
+	if (a->seg_inode != b->seg_inode)
+		return a->seg_inode < b->seg_inode;
+	if (a->seg_ofs != b->seg_ofs)
+		return a->seg_ofs < b->seg_ofs;
+	return a->seg_bytes < b->seg_bytes;
+}
+
+/* Hashes a page by its user virtual address. */
+static uint64_t
+page_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page *page = hash_entry (e, struct page, spt_elem);
+	return hash_bytes (&page->va, sizeof page->va);
+}
+
+/* Orders pages by user virtual address. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct page, spt_elem)->va
+		< hash_entry (b, struct page, spt_elem)->va;
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	hash_init (&spt->pages, page_hash, page_less, NULL);
+	list_init (&spt->regions);
+	spt->region_root = NULL;
+}
+
+/* Copies the pending (never touched) page SRC into DST.  Its loader
+ * information is duplicated so that both processes own one. */
+static bool
+copy_uninit_page (struct supplemental_page_table *dst, struct page *src) {
+	struct lazy_load_info *aux = NULL;
+
+	if (src->uninit.aux != NULL) {
+		struct vm_region *region = spt_find_region (dst, src->va);
+
+		aux = malloc (sizeof *aux);
+		if (aux == NULL)
+			return false;
+		*aux = *(struct lazy_load_info *) src->uninit.aux;
+		if (region != NULL)
+			aux->file = region->file;
+	}
+	if (!vm_alloc_page_with_initializer (src->uninit.type, src->va,
+				src->writable, src->uninit.init, aux)) {
+		free (aux);
+		return false;
+	}
+	return true;
+}
+
+/* Copies the initialized page SRC into DST.  Instead of copying its
+ * contents, the new page shares SRC's frame read-only; the first write
+ * by either process makes a private copy in vm_handle_wp(). */
+static bool
+copy_resident_page (struct supplemental_page_table *dst, struct page *src) {
+	struct page *page;
+
+	if (!vm_alloc_page (page_get_type (src), src->va, src->writable))
+		return false;
+	page = spt_find_page (dst, src->va);
+
+	/* Bring SRC back in if it was evicted. */
+	while (!vm_pin_page (src))
+		if (!vm_do_claim_page (src))
+			return false;
+
+	/* Take on SRC's state directly; the page never goes through its
+	 * initializer, which would clobber the shared frame. */
+	page->operations = src->operations;
+	if (page_get_type (src) == VM_FILE) {
+		page->file = src->file;
+		page->file.file = spt_find_region (dst, src->va)->file;
+		page->file.dirty = false;
+	} else
+		page->anon = src->anon;
+
+	lock_acquire (&frame_lock);
+	if (src->writable)
+		remap_page (src, src->frame->kva, false);
+	frame_link (src->frame, page);
+	src->frame->pin_cnt--;
+	cow_share_cnt++;
+	lock_release (&frame_lock);
+
+	if (!pml4_set_page (page->owner->pml4, page->va, page->frame->kva, false)) {
+		vm_free_frame (page);
+		return false;
+	}
+	return true;
 }
 
 /* Copy supplemental page table from src to dst */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct hash_iterator i;
+	struct list_elem *e;
+	uint64_t start = rdtsc ();
+
+	/* Regions first, so the pages can find their backing files and
+	 * shared memory. */
+	for (e = list_begin (&src->regions); e != list_end (&src->regions);
+			e = list_next (e)) {
+		struct vm_region *r = list_entry (e, struct vm_region, elem);
+		struct vm_region *copy;
+		struct file *file = NULL;
+
+		if (r->file != NULL && (file = file_reopen (r->file)) == NULL)
+			return false;
+		copy = spt_add_region (dst, r->start, r->end, r->kind, r->writable,
+				file, r->offset);
+		if (copy == NULL) {
+			file_close (file);
+			return false;
+		}
+		if (r->shm != NULL)
+			copy->shm = shm_get (r->shm);
+		copy->advice = r->advice;
+	}
+
+	hash_first (&i, &src->pages);
+	while (hash_next (&i)) {
+		struct page *page = hash_entry (hash_cur (&i), struct page, spt_elem);
+		bool success;
+
+		if (VM_TYPE (page->operations->type) == VM_UNINIT)
+			success = copy_uninit_page (dst, page);
+		else if (page_get_type (page) == VM_SHM)
+			/* The child maps the same frames on its own faults. */
+			success = vm_alloc_page_with_initializer (VM_SHM, page->va,
+					page->writable, shm_load, NULL);
+		else
+			success = copy_resident_page (dst, page);
+		if (!success)
+			return false;
+	}
+
+	fork_cnt++;
+	fork_cycles += rdtsc () - start;
+	return true;
+}
+
+/* Destroys the page in hash element E. */
+static void
+spt_destroy_page (struct hash_elem *e, void *aux UNUSED) {
+	vm_dealloc_page (hash_entry (e, struct page, spt_elem));
 }
 
 /* Free the resource hold by the supplemental page table */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	/* Page destructors write back modified file pages, so the regions
+	 * that own the files go last. */
+	hash_clear (&spt->pages, spt_destroy_page);
+	while (!list_empty (&spt->regions))
+		spt_remove_region (spt, list_entry (list_front (&spt->regions),
+					struct vm_region, elem));
+}
+
+/* Frees the page table of SPT, which supplemental_page_table_kill()
+ * emptied.  A killed table can be filled again, as exec does; a
+ * destroyed one cannot. */
+void
+supplemental_page_table_destroy (struct supplemental_page_table *spt) {
+	ASSERT (hash_empty (&spt->pages));
+	hash_destroy (&spt->pages, NULL);
+}
+
+/* Prints VM statistics. */
+void
+vm_print_stats (void) {
+	char buf[256];
+	unsigned type;
+
+	printf ("VM: %lld faults handled, %llu cycles/fault\n", fault_cnt,
+			fault_cnt > 0 ? fault_cycles / fault_cnt : 0);
+	for (type = 0; type < VM_FAULT_TYPE_CNT; type++)
+		if (fault_type_cnt[type] != 0) {
+			format_hist (buf, sizeof buf, fault_hist[type]);
+			printf ("VM: %lld %s faults, latency (log2 cycles):%s\n",
+					fault_type_cnt[type], fault_type_names[type], buf);
+		}
+	printf ("VM: %lld victims scanned, %lld clean evictions, "
+			"%lld dirty evictions, %lld refaults\n",
+			victims_scanned, clean_evict_cnt, dirty_evict_cnt, refault_cnt);
+	printf ("VM: %lld evictions to keep processes within their limits\n",
+			limit_evict_cnt);
+	printf ("VM: %lld forks, %llu cycles/fork, %lld frames shared, "
+			"%lld copied on write\n", fork_cnt,
+			fork_cnt > 0 ? fork_cycles / fork_cnt : 0, cow_share_cnt,
+			cow_copy_cnt);
+	printf ("VM: %lld read faults mapped the zero page, %lld wrote to it\n",
+			zero_map_cnt, zero_copy_cnt);
+	printf ("VM: %lld segment pages shared, %lld loaded, %lld dropped\n",
+			seg_share_cnt, seg_load_cnt, seg_drop_cnt);
+	printf ("VM: %lld pages mapped by fault-around, %lld read ahead, "
+			"%lld dropped behind\n", around_cnt, readahead_cnt,
+			drop_behind_cnt);
+	printf ("VM: %lld pages prefetched by madvise, %lld released\n",
+			willneed_cnt, dontneed_cnt);
+	file_print_stats ();
+	ksm_print_stats ();
+	oom_print_stats ();
+	swap_print_stats ();
 }